@@ -0,0 +1,306 @@
+#include "ft_ssl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Microbenchmark suite, `make bench` builds and runs it, `--json` makes it machine-readable for
+// bench/compare.py (`make bench-baseline`, then `make bench-check` after a change)
+
+#define BENCH_DURATION_MS 200 // per run of a benchmark, FT_SSL_BENCH_MS overrides it
+#define BENCH_RUNS 3 // the suite is run that many times, the best run of each benchmark is kept
+#define BENCH_MAX_RESULTS 64
+#define BENCH_CHOMP_PIECE 1000 // odd size, most pieces go through the context buffer
+#define BENCH_CORPUS_DIR "bench_corpus"
+#define BENCH_CORPUS_FILES 32 // file i is (i + 1) * 37 KiB + i bytes, about 20 MiB in all
+
+/**
+ * A result, the higher the value the better
+*/
+typedef struct s_bench_result {
+    char name[64];                      // e.g. "sha256_digest/sha-ni"
+    char *unit;                         // "MB/s" or "ops/s"
+    f64 value;
+    f64 cycles;                         // TSC cycles per byte (MB/s) or per operation (ops/s)
+} t_bench_result;
+
+static byte _buffer[BUFFER_SIZE * 4];
+static t_bench_result _results[BENCH_MAX_RESULTS];
+static i32 _nresults = 0;
+static f64 _duration = BENCH_DURATION_MS / 1000.0;
+
+static f64 _now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/**
+ * @brief Records a result, or keeps the best of it and the one of a previous run
+ *
+ * @param name Benchmark name, then an optional variant after a slash
+ * @param variant Variant (kernel, algorithm)
+ * @param unit "MB/s" if amount is a number of bytes, "ops/s" otherwise
+ * @param amount Bytes or operations done
+ * @param elapsed Seconds spent
+ * @param cycles TSC cycles spent
+ */
+static void _bench_record(const char *name, const char *variant, char *unit, u64 amount, f64 elapsed, u64 cycles) {
+    t_bench_result result;
+
+    snprintf(result.name, sizeof(result.name), "%s/%s", name, variant);
+    result.unit = unit;
+    result.value = ft_strcmp(unit, "MB/s") == 0 ? amount / elapsed / 1e6 : amount / elapsed;
+    result.cycles = (f64) cycles / amount;
+    // noise only ever makes a run slower
+    for (i32 i = 0; i < _nresults; i++) {
+        if (ft_strcmp(_results[i].name, result.name) == 0) {
+            if (result.value > _results[i].value) {
+                _results[i] = result;
+            }
+            return ;
+        }
+    }
+    if (_nresults < BENCH_MAX_RESULTS) {
+        _results[_nresults++] = result;
+    }
+}
+
+/**
+ * @brief Runs every kernel of a table this CPU supports on a full buffer, straight
+ *
+ * @param ctx Fresh context of the algorithm
+ * @param kernels Kernel table of the algorithm
+ * @param name Benchmark name, e.g. "md5_digest"
+ */
+static void _bench_kernels(t_context ctx, const t_kernel *kernels, const char *name) {
+    for (i32 i = 0; kernels[i].name != NULL; i++) {
+        if (!IS_SET(cpu_features(), kernels[i].cpu_flags)) {
+            continue;
+        }
+        u64 bytes = 0;
+        u64 start_cycles = cpu_cycles();
+        f64 start = _now(), elapsed;
+        do {
+            for (i32 j = 0; j < 16; j++) {
+                kernels[i].digest_fn(ctx.digest, _buffer, BUFFER_SIZE / BLOCK_SIZE);
+            }
+            bytes += 16 * BUFFER_SIZE;
+            elapsed = _now() - start;
+        } while (elapsed < _duration);
+        _bench_record(name, kernels[i].name, "MB/s", bytes, elapsed, cpu_cycles() - start_cycles);
+    }
+}
+
+/**
+ * @brief Feeds the context in small pieces, then finalizes, with the kernel ft_ssl picks
+ */
+static void _bench_chomp(t_context ctx) {
+    u64 bytes = 0;
+    u64 start_cycles = cpu_cycles();
+    f64 start = _now(), elapsed;
+
+    do {
+        ctx.reset_fn(&ctx);
+        for (u64 i = 0; i < sizeof(_buffer); i += BENCH_CHOMP_PIECE) {
+            ctx_chomp(&ctx, _buffer + i, i + BENCH_CHOMP_PIECE < sizeof(_buffer) ? BENCH_CHOMP_PIECE : sizeof(_buffer) - i);
+        }
+        ctx.final_fn(&ctx);
+        bytes += sizeof(_buffer);
+        elapsed = _now() - start;
+    } while (elapsed < _duration);
+    _bench_record("ctx_chomp", ctx.alg_name, "MB/s", bytes, elapsed, cpu_cycles() - start_cycles);
+}
+
+/**
+ * @brief Turns the same digest into hex over and over
+ */
+static void _bench_hexdigest(t_context ctx) {
+    unsigned char hex[MAX_DIGEST_SIZE * 2 + 1];
+    u64 ops = 0, sink = 0;
+    u64 start_cycles = cpu_cycles();
+    f64 start = _now(), elapsed;
+
+    do {
+        for (i32 i = 0; i < 1024; i++) {
+            ctx.digest[0] = i;
+            ctx_hexdigest(&ctx, hex);
+            sink += hex[1];
+        }
+        ops += 1024;
+        elapsed = _now() - start;
+    } while (elapsed < _duration);
+    _bench_record("ctx_hexdigest", ctx.alg_name, "ops/s", ops, elapsed, cpu_cycles() - start_cycles);
+    // keeps the calls from being optimized out
+    if (sink == 0) {
+        printf("\n");
+    }
+}
+
+/**
+ * @brief Runs every hex implementation this CPU supports on a SHA-256 digest, both ways
+ */
+static void _bench_hex(void) {
+    const t_hex_kernel *kernels = hex_kernels();
+    char hex[SHA256_DIGEST_SIZE * 2];
+    byte bytes[SHA256_DIGEST_SIZE];
+    u64 sink = 0;
+
+    for (i32 i = 0; kernels[i].name != NULL; i++) {
+        if (!IS_SET(cpu_features(), kernels[i].cpu_flags)) {
+            continue;
+        }
+        u64 ops = 0;
+        u64 start_cycles = cpu_cycles();
+        f64 start = _now(), elapsed;
+        do {
+            for (i32 j = 0; j < 1024; j++) {
+                _buffer[0] = j;
+                kernels[i].encode_fn(_buffer, hex, SHA256_DIGEST_SIZE);
+                sink += hex[1];
+            }
+            ops += 1024;
+            elapsed = _now() - start;
+        } while (elapsed < _duration);
+        _bench_record("hex_encode", kernels[i].name, "ops/s", ops, elapsed, cpu_cycles() - start_cycles);
+        ops = 0;
+        start_cycles = cpu_cycles();
+        start = _now();
+        do {
+            for (i32 j = 0; j < 1024; j++) {
+                hex[0] = "0123456789abcdef"[j & 0x0F];
+                sink += kernels[i].decode_fn(hex, bytes, SHA256_DIGEST_SIZE) + bytes[0];
+            }
+            ops += 1024;
+            elapsed = _now() - start;
+        } while (elapsed < _duration);
+        _bench_record("hex_decode", kernels[i].name, "ops/s", ops, elapsed, cpu_cycles() - start_cycles);
+    }
+    // keeps the calls from being optimized out
+    if (sink == 0) {
+        printf("\n");
+    }
+}
+
+/**
+ * @brief Writes the fixed corpus of the file benchmark, the same bytes on every run
+ *
+ * @return true Success, false if a file couldn't be written
+ */
+static bool _bench_corpus_create(void) {
+    char path[64];
+    byte *data = malloc((BENCH_CORPUS_FILES + 1) * 37 * 1024);
+
+    if (data == NULL || (mkdir(BENCH_CORPUS_DIR, 0755) == -1 && errno != EEXIST)) {
+        free(data);
+        return (false);
+    }
+    for (u64 i = 0; i < (BENCH_CORPUS_FILES + 1) * 37 * 1024; i++) {
+        data[i] = (byte) (i * 2654435761U >> 13);
+    }
+    for (i32 i = 0; i < BENCH_CORPUS_FILES; i++) {
+        u64 size = (i + 1) * 37 * 1024 + i;
+        snprintf(path, sizeof(path), BENCH_CORPUS_DIR "/%02d", i);
+        i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || write(fd, data, size) != (i64) size) {
+            close(fd);
+            free(data);
+            return (false);
+        }
+        close(fd);
+    }
+    free(data);
+    return (true);
+}
+
+static void _bench_corpus_remove(void) {
+    char path[64];
+
+    for (i32 i = 0; i < BENCH_CORPUS_FILES; i++) {
+        snprintf(path, sizeof(path), BENCH_CORPUS_DIR "/%02d", i);
+        unlink(path);
+    }
+    rmdir(BENCH_CORPUS_DIR);
+}
+
+/**
+ * @brief Hashes every file of the corpus the way ft_ssl does (open, chomp the fd, final)
+ *
+ * @note The corpus is in the page cache after the first pass, this times hashing, not the disk
+ */
+static void _bench_files(t_context ctx) {
+    char path[64];
+    u64 bytes = 0;
+    u64 start_cycles = cpu_cycles();
+    f64 start = _now(), elapsed;
+
+    do {
+        for (i32 i = 0; i < BENCH_CORPUS_FILES; i++) {
+            snprintf(path, sizeof(path), BENCH_CORPUS_DIR "/%02d", i);
+            i32 fd = open(path, O_RDONLY);
+            if (fd == -1) {
+                return ;
+            }
+            ctx.reset_fn(&ctx);
+            ctx_chomp_fd(&ctx, 1, fd);
+            ctx.final_fn(&ctx);
+            bytes += ctx.chomped_bytes;
+            close(fd);
+        }
+        elapsed = _now() - start;
+    } while (elapsed < _duration);
+    _bench_record("file", ctx.alg_name, "MB/s", bytes, elapsed, cpu_cycles() - start_cycles);
+}
+
+static void _bench_print_table(void) {
+    for (i32 i = 0; i < _nresults; i++) {
+        printf("%-24s %12.1f %-5s %10.2f cycles/%s\n", _results[i].name, _results[i].value, _results[i].unit,
+            _results[i].cycles, ft_strcmp(_results[i].unit, "MB/s") == 0 ? "byte" : "op");
+    }
+}
+
+static void _bench_print_json(void) {
+    printf("{\n  \"version\": 1,\n  \"cpu_features\": %u,\n  \"duration_ms\": %.0f,\n  \"runs\": %d,\n  \"results\": [\n",
+        cpu_features(), _duration * 1000, BENCH_RUNS);
+    for (i32 i = 0; i < _nresults; i++) {
+        printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f, \"cycles\": %.3f}%s\n", _results[i].name,
+            _results[i].unit, _results[i].value, _results[i].cycles, i + 1 < _nresults ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    bool json = argc == 2 && ft_strcmp(argv[1], "--json") == 0;
+    char *ms = getenv("FT_SSL_BENCH_MS");
+
+    if (argc > 2 || (argc == 2 && !json)) {
+        fprintf(stderr, "usage: %s [--json]\n", argv[0]);
+        return (1);
+    }
+    if (ms != NULL && *ms != '\0') {
+        _duration = strtoul(ms, NULL, 10) / 1000.0;
+    }
+    for (u32 i = 0; i < sizeof(_buffer); i++) {
+        _buffer[i] = (byte) (i * 31 + 7);
+    }
+    if (!_bench_corpus_create()) {
+        _bench_corpus_remove();
+        fprintf(stderr, "%s: can't write the corpus in " BENCH_CORPUS_DIR "\n", argv[0]);
+        return (1);
+    }
+    for (i32 run = 0; run < BENCH_RUNS; run++) {
+        _bench_kernels(md5_init(0), md5_kernels(), "md5_digest");
+        _bench_kernels(sha256_init(0), sha256_kernels(), "sha256_digest");
+        _bench_chomp(md5_init(0));
+        _bench_chomp(sha256_init(0));
+        _bench_hexdigest(md5_init(0));
+        _bench_hexdigest(sha256_init(0));
+        _bench_hex();
+        _bench_files(md5_init(0));
+        _bench_files(sha256_init(0));
+    }
+    _bench_corpus_remove();
+    json ? _bench_print_json() : _bench_print_table();
+    return (0);
+}
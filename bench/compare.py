@@ -0,0 +1,53 @@
+import argparse
+import json
+import sys
+
+"""
+Compares two runs of `ft_ssl_bench --json`, flags the benchmarks that got slower than the baseline
+by more than a threshold. Every value is a rate (MB/s, ops/s), higher is better.
+
+python3 bench/compare.py bench/baseline.json bench/current.json [--threshold 10]
+"""
+
+def load(path: str) -> dict:
+    with open(path) as f:
+        report = json.load(f)
+    if report.get("version") != 1:
+        raise ValueError(f"{path}: unknown report version {report.get('version')}")
+    return report
+
+def compare(baseline: dict, current: dict, threshold: float) -> list:
+    """
+    returns the names of the benchmarks that regressed, prints a line per benchmark
+    """
+    before = {r["name"]: r for r in baseline["results"]}
+    regressions = []
+    if baseline.get("cpu_features") != current.get("cpu_features"):
+        print("[!] the runs didn't use the same CPU features, kernels may differ")
+    for result in current["results"]:
+        name, value = result["name"], result["value"]
+        if name not in before:
+            print(f"{name:<24} {value:14.1f} {result['unit']:<5}  new")
+            continue
+        old = before[name]["value"]
+        delta = (value - old) / old * 100 if old > 0 else 0
+        status = "ok"
+        if delta < -threshold:
+            status = "SLOWER"
+            regressions.append(name)
+        print(f"{name:<24} {value:14.1f} {result['unit']:<5} {delta:+7.1f}%  {status}")
+    for name in before:
+        if name not in {r["name"] for r in current["results"]}:
+            print(f"{name:<24} {'':14} {'':5}  gone")
+    return regressions
+
+if __name__ == "__main__":
+    args = argparse.ArgumentParser()
+    args.add_argument("baseline")
+    args.add_argument("current")
+    args.add_argument("--threshold", type=float, default=10, help="slowdown in percent that fails (default: 10)")
+    args = args.parse_args()
+    regressions = compare(load(args.baseline), load(args.current), args.threshold)
+    if regressions:
+        print(f"[!] {len(regressions)} benchmark(s) more than {args.threshold:g}% slower: {', '.join(regressions)}")
+        sys.exit(1)
@@ -3,7 +3,9 @@ import random
 import hashlib
 import subprocess
 import os
+import shutil
 import sys
+import time
 import argparse
 from uuid import uuid4
 from typing import Tuple
@@ -32,6 +34,9 @@ CORPUSES = {
     },
     "subject": {}, # special case
     "args": {},
+    "lib": {}, # libft_ssl.so through ctypes
+    "bench": {}, # timing suite of ft_ssl_bench, against bench/baseline.json if there is one
+    "serve": {}, # requests to ft_ssl serve through a Unix socket
 }
 
 PRINT_LOCK = Lock()
@@ -42,6 +47,21 @@ def md5(s: str) -> str:
 def sha256(s: str) -> str:
     return hashlib.sha256(s.encode()).hexdigest()
 
+def tree_root(data: bytes, chunk: int, alg: str = "sha256") -> str:
+    """
+    reference root of -t: leaves H(0x00 || chunk), nodes H(0x01 || left || right), as in RFC 6962
+    """
+    def mth(nodes: list) -> bytes:
+        if len(nodes) == 1:
+            return nodes[0]
+        k = 1
+        while k * 2 < len(nodes):
+            k *= 2
+        return hashlib.new(alg, b"\x01" + mth(nodes[:k]) + mth(nodes[k:])).digest()
+    if len(data) == 0:
+        return hashlib.new(alg, b"").hexdigest()
+    return mth([hashlib.new(alg, b"\x00" + data[i:i + chunk]).digest() for i in range(0, len(data), chunk)]).hex()
+
 random_string = lambda n: ''.join(random.choices(string.ascii_letters + string.digits, k=n))
 
 def get_output(args: list) -> Tuple[str, bool]:
@@ -152,6 +172,22 @@ def run_exit_code(args: list) -> int:
     p = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
     return p.wait()
 
+def run_shrinking(args: list) -> Tuple[int, bytes]:
+    # 4 GiB sparse file, cut to 1 MiB as soon as ft_ssl has it mapped: hashing it takes far longer than
+    # noticing the mapping, the pages past the new end fault whatever the speed of the machine
+    path = os.path.abspath("shrinking")
+    with open(path, "wb") as f:
+        f.truncate(4 * 1024 * 1024 * 1024)
+    p = subprocess.Popen(args + ["shrinking"], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    while p.poll() is None:
+        with open(f"/proc/{p.pid}/maps") as maps:
+            if path in maps.read():
+                break
+    os.truncate(path, 1024 * 1024)
+    out, _ = p.communicate()
+    os.remove(path)
+    return p.returncode, out
+
 if __name__ == "__main__":
     try:
         subprocess.check_call(["make"], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
@@ -250,11 +286,350 @@ if __name__ == "__main__":
         assert run_exit_code(["./ft_ssl", "sha256", "-s"]) != 0
         assert run_exit_code(["./ft_ssl", "md5", "-s", "a"]) == 0
         assert run_exit_code(["./ft_ssl", "md5", "-s", "a"]) == 0
+        # jobs
+        assert run_exit_code(["./ft_ssl", "md5", "-j"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-j", "x", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-j", "-1", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-j", "2", "-j", "2", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-j", "2", "-s", "a"]) == 0
+        assert run_exit_code(["./ft_ssl", "md5", "-j0", "-s", "a"]) == 0
+        with open("file", "w") as f:
+            f.write("And above all,\n")
+        assert run_args(["./ft_ssl", "md5", "-r", "-j", "3", "file", "nope", "file", "file"]) == "53d53ea94217b259c11a5a2d104ec58a file\nft_ssl: file not found: 'nope'\n53d53ea94217b259c11a5a2d104ec58a file\n53d53ea94217b259c11a5a2d104ec58a file"
+        # recursive, the output is in byte order of the paths, only regular files are hashed
+        shutil.rmtree("rtree", ignore_errors=True)
+        for d in ["rtree/a", "rtree/b/c", "rtree/empty"]:
+            os.makedirs(d)
+        expected = []
+        for path in ["rtree/a.txt", "rtree/a/x", "rtree/a0", "rtree/b/c/y", "rtree/b/z", "rtree/zz"]:
+            with open(path, "w") as f:
+                f.write(path)
+            expected.append(f"{md5(path)} {path}")
+        os.symlink("a", "rtree/link")
+        os.mkfifo("rtree/fifo")
+        for jobs in ["1", "3"]:
+            assert run_args(["./ft_ssl", "md5", "-R", "-r", "-j", jobs, "rtree/", "nope", "file"]) == "\n".join(expected) + "\nft_ssl: file not found: 'nope'\n53d53ea94217b259c11a5a2d104ec58a file"
+        assert run_exit_code(["./ft_ssl", "md5", "-R", "-R", "rtree"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-R", "-t", "1K", "rtree"]) != 0
+        # would be ignored: -c and the saved states don't walk directories
+        assert run_exit_code(["./ft_ssl", "md5", "-R", "-c", "/dev/null"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-R", "--save-state", "rtree.state", "file"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-R", "--resume", "rtree.state", "file"]) != 0
+        assert not os.path.exists("rtree.state")
+        shutil.rmtree("rtree")
+        # paths read from a list, newline or NUL delimited, the last one may not be terminated
+        digest = "53d53ea94217b259c11a5a2d104ec58a"
+        assert run_args(["./ft_ssl", "md5", "-r", "--files-from", "-", "file"], "file\n\nnope\nfile") == f"{digest} file\n{digest} file\nft_ssl: file not found: 'nope'\n{digest} file"
+        assert run_args(["./ft_ssl", "md5", "-q", "-0", "--files-from", "-"], "file\0file\0") == f"{digest}\n{digest}"
+        with open("list_test", "w") as f:
+            f.write("file\n" * 20000)
+        assert run_args(["./ft_ssl", "md5", "-q", "--files-from", "list_test"]) == "\n".join([digest] * 20000)
+        os.remove("list_test")
+        p = subprocess.run(["./ft_ssl", "md5", "-q", "--files-from", "-"], input=b"a" * 70000 + b"\nfile\n", capture_output=True)
+        assert p.returncode != 0 and p.stdout == f"{digest}\n".encode() and p.stderr.count(b"path too long") == 1
+        assert run_exit_code(["./ft_ssl", "md5", "-0", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "--files-from"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "--files-from", "nope"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "--files-from", "-", "-p"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "--files-from", "a", "--files-from", "a"]) != 0
+        # hmac, keys shorter and longer than a block
+        import hmac
+        for alg in ("md5", "sha256"):
+            for key in ("k", random_string(64), random_string(200)):
+                message = random_string(random.randint(0, 300))
+                mac = hmac.new(key.encode(), message.encode(), alg).hexdigest()
+                assert run_args(["./ft_ssl", f"hmac-{alg}", "-k", key, "-s", message]) == f'HMAC-{alg.upper()} ("{message}") = {mac}'
+                assert run_args(["./ft_ssl", f"hmac-{alg}", "-k", key, "-q"], message) == mac
+                with open("hmac_test", "w") as f:
+                    f.write(message)
+                assert run_args(["./ft_ssl", f"hmac-{alg}", "-r", "-k", key, "hmac_test"]) == f"{mac} hmac_test"
+                lines = [random_string(random.randint(0, 150)).replace("\n", "") for _ in range(500)]
+                macs = [hmac.new(key.encode(), l.encode(), alg).hexdigest() for l in lines]
+                assert run_args(["./ft_ssl", f"hmac-{alg}", "-k", key, "--lines"], "\n".join(lines)) == "\n".join(macs)
+        os.remove("hmac_test")
+        assert run_exit_code(["./ft_ssl", "hmac-md5", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "hmac-md5", "-k", "a", "-k", "b", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "hmac-md5", "-k", "a", "--lines", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "hmac-md5", "-k", "a", "-x"]) != 0
+        assert run_exit_code(["./ft_ssl", "hmac-md5", "-k", "a", "nope"]) != 0
+        # pbkdf2, one chain at a time and in lanes (with and without the SHA extensions)
+        passwords = [random_string(random.randint(0, 100)) for _ in range(40)]
+        for cpu, length, jobs in (("ff", 32, "1"), ("1f", 33, "3"), ("0", 100, "2"), ("ff", 1, "0")):
+            os.environ["FT_SSL_CPU"] = cpu
+            keys = [hashlib.pbkdf2_hmac("sha256", p.encode(), b"salt", 50, length).hex() for p in passwords]
+            assert run_args(["./ft_ssl", "pbkdf2", "-s", "salt", "-i", "50", "-l", str(length), "-j", jobs], "\n".join(passwords)) == "\n".join(keys)
+            assert run_args(["./ft_ssl", "pbkdf2", "-p", passwords[0], "-s", "", "-i", "1000", "-l", str(length)]) == hashlib.pbkdf2_hmac("sha256", passwords[0].encode(), b"", 1000, length).hex()
+        del os.environ["FT_SSL_CPU"]
+        p = subprocess.run(["./ft_ssl", "pbkdf2", "-s", "s", "-i", "1"], input=b"", capture_output=True)
+        assert p.returncode != 0 and p.stdout == b"" and p.stderr == b"ft_ssl: no password to derive a key from: '(stdin)'\n"
+        assert run_exit_code(["./ft_ssl", "pbkdf2", "-p", "a", "-i", "1"]) != 0
+        assert run_exit_code(["./ft_ssl", "pbkdf2", "-p", "a", "-s", "s"]) != 0
+        assert run_exit_code(["./ft_ssl", "pbkdf2", "-p", "a", "-s", "s", "-i", "0"]) != 0
+        assert run_exit_code(["./ft_ssl", "pbkdf2", "-p", "a", "-s", "s", "-i", "1", "-l", "1025"]) != 0
+        assert run_exit_code(["./ft_ssl", "pbkdf2", "-p", "a", "-s", "s", "-i", "1", "-i", "1"]) != 0
+        assert run_exit_code(["./ft_ssl", "pbkdf2", "-p", "a", "-s", "s", "-i", "1", "file"]) != 0
+        # multi
+        assert run_exit_code(["./ft_ssl", "multi", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "multi", "-a", "md5,sha1", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "multi", "-a", "md5,", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-a", "md5", "-s", "a"]) != 0
+        assert run_args(["./ft_ssl", "multi", "-a", "md5,sha256", "-s", "foo", "file"]) == 'MD5 ("foo") = acbd18db4cc2f85cedef654fccc4a4d8\nSHA256 ("foo") = 2c26b46b68ffc68ff99b453c1d30413413422d706483bfa0f98a5e886266e7ae\nMD5 (file) = 53d53ea94217b259c11a5a2d104ec58a\nSHA256 (file) = f9eb9a5a063eb386a18525c074e1065c316ec434f911e0d7d59ba2d9fd134705'
+        # stdin too, every line names its algorithm, -p repeats the echo on each
+        md5_hi, sha256_hi = hashlib.md5(b"hi\n").hexdigest(), hashlib.sha256(b"hi\n").hexdigest()
+        assert run_args(["./ft_ssl", "multi", "-a", "md5,sha256"], "hi\n") == f"MD5 (stdin) = {md5_hi}\nSHA256 (stdin) = {sha256_hi}"
+        assert run_args(["./ft_ssl", "multi", "-a", "md5,sha256", "-p"], "hi\n") == f'MD5 ("hi") = {md5_hi}\nSHA256 ("hi") = {sha256_hi}'
+        assert run_args(["./ft_ssl", "multi", "-a", "md5,sha256", "-p", "-q"], "hi\n") == f"hi\n{md5_hi}\n{sha256_hi}"
+        # tree hashing
+        assert run_exit_code(["./ft_ssl", "md5", "-t"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-t", "1000", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-t", "512", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-t", "2G", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-t", "1K", "-t", "1K", "-s", "a"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-t", "1K", "-p"]) != 0
+        assert run_exit_code(["./ft_ssl", "multi", "-a", "md5", "-t", "1K", "-s", "a"]) != 0
+        data = random_string(random.randint(5000, 20000)).encode()
+        with open("file", "wb") as f:
+            f.write(data)
+        for alg in ("md5", "sha256"):
+            assert run_args(["./ft_ssl", alg, "-t", "1K", "-j", "3", "file"]) == f"{alg.upper()}-TREE-1K (file) = {tree_root(data, 1024, alg)}"
+            assert run_args(["./ft_ssl", alg, "-t4096", "-q"], data.decode()) == tree_root(data, 4096, alg)
+        assert run_args(["./ft_ssl", "sha256", "-t", "1M", "-q", "-s", ""]) == tree_root(b"", 1 << 20)
+        # manifest verification
+        with open("file", "w") as f:
+            f.write("And above all,\n")
+        assert run_exit_code(["./ft_ssl", "md5", "-c"]) != 0
+        assert run_exit_code(["./ft_ssl", "md5", "-c", "nope"]) != 0
+        manifest = run_args(["./ft_ssl", "md5", "file", "file"]) + "\n" + run_args(["./ft_ssl", "md5", "-r", "file"])
+        assert run_args(["./ft_ssl", "md5", "-c", "-"], manifest) == "file: OK\nfile: OK\nfile: OK\nft_ssl: 3 OK, 0 FAILED, 0 unreadable, 0 improperly formatted"
+        assert run_args(["./ft_ssl", "md5", "-c", "-", "-q", "-j", "2"], manifest.upper().replace("FILE", "file") + "\nbad line") == "ft_ssl: 3 OK, 0 FAILED, 0 unreadable, 1 improperly formatted"
+        # every hex kernel (ssse3, scalar) decodes the same digests, in any case, and rejects the same lines
+        sha_manifest = "SHA256 (file) = " + sha256("And above all,\n").upper() + "\n" + sha256("And above all,\n") + " file\n" + sha256("And above all,\n")[:-1] + "g file"
+        for mask in ["ff", "0"]:
+            os.environ["FT_SSL_CPU"] = mask
+            assert run_args(["./ft_ssl", "sha256", "-c", "-"], sha_manifest) == "file: OK\nfile: OK\nft_ssl: 2 OK, 0 FAILED, 0 unreadable, 1 improperly formatted"
+            assert run_args(["./ft_ssl", "sha256", "file"]) == "SHA256 (file) = " + sha256("And above all,\n")
+        del os.environ["FT_SSL_CPU"]
+        assert run_args(["./ft_ssl", "md5", "-c", "-", "-q"], manifest.replace("53d5", "0000") + "\n" + "0" * 32 + " nope") == "file: FAILED\nfile: FAILED\nfile: FAILED\nft_ssl: file not found: 'nope'\nft_ssl: 0 OK, 3 FAILED, 1 unreadable, 0 improperly formatted"
+        # digest cache, the file must look old enough to be stored
+        os.environ["FT_SSL_CACHE"] = "cache_test"
+        with open("file", "w") as f:
+            f.write("And above all,\n")
+        os.utime("file", (1, 1))
+        assert run_args(["./ft_ssl", "md5", "-r", "file", "file"]) == "53d53ea94217b259c11a5a2d104ec58a file\n53d53ea94217b259c11a5a2d104ec58a file"
+        assert "hits: 1\nmisses: 1" in run_args(["./ft_ssl", "cache", "stats"])
+        with open("file", "w") as f:
+            f.write("And above all,\r\n")
+        os.utime("file", (1, 1))
+        assert run_args(["./ft_ssl", "md5", "-q", "file"]) == md5("And above all,\r\n")
+        assert run_exit_code(["./ft_ssl", "cache", "clear"]) == 0
+        assert "entries: 0/" in run_args(["./ft_ssl", "cache", "stats"])
+        assert run_exit_code(["./ft_ssl", "cache", "nope"]) != 0
+        del os.environ["FT_SSL_CACHE"]
+        os.remove("cache_test")
+        assert run_exit_code(["./ft_ssl", "cache", "stats"]) != 0
+        # saved states
+        for alg in ("md5", "sha256"):
+            data = random_string(random.randint(0, 5000))
+            cut = random.randint(0, len(data))
+            with open("file", "w") as f:
+                f.write(data[:cut])
+            assert run_args(["./ft_ssl", alg, "-q", "--save-state", "state_test", "file"]) == hashlib.new(alg, data[:cut].encode()).hexdigest()
+            with open("file", "w") as f:
+                f.write(data)
+            assert run_args(["./ft_ssl", alg, "-q", "--resume", "state_test", "file"]) == hashlib.new(alg, data.encode()).hexdigest()
+            assert run_args(["./ft_ssl", alg, "-q", "--resume", "state_test"], data[cut:]) == hashlib.new(alg, data.encode()).hexdigest()
+            # a byte count saves the state in the middle of the input, the digest is still the whole input's
+            if cut > 0:
+                assert run_args(["./ft_ssl", alg, "-q", "--save-state", f"state_test:{cut}", "file"]) == hashlib.new(alg, data.encode()).hexdigest()
+                assert run_args(["./ft_ssl", alg, "-q", "--save-state", f"state_test:{cut}"], data) == hashlib.new(alg, data.encode()).hexdigest()
+                assert run_args(["./ft_ssl", alg, "-q", "--resume", "state_test"], data[cut:]) == hashlib.new(alg, data.encode()).hexdigest()
+        assert run_exit_code(["./ft_ssl", "md5", "--resume", "state_test", "file"]) != 0
+        assert run_exit_code(["./ft_ssl", "sha256", "--resume", "state_test", "file", "file"]) != 0
+        assert run_exit_code(["./ft_ssl", "sha256", "--resume"]) != 0
+        assert run_exit_code(["./ft_ssl", "sha256", "--save-state", "state_test:0", "file"]) != 0
+        assert run_exit_code(["./ft_ssl", "sha256", "--save-state", f"state_test:{len(data) + 1}", "file"]) != 0
+        # the count includes the resumed bytes, it can't be before them
+        assert run_args(["./ft_ssl", "sha256", "-q", "--save-state", "state_test:10"], "0123456789abcdef") == hashlib.sha256(b"0123456789abcdef").hexdigest()
+        assert run_args(["./ft_ssl", "sha256", "--resume", "state_test", "--save-state", "state_test:5"], "abcdef") == "ft_ssl: no state to save at that byte count: '(stdin)'"
+        assert run_args(["./ft_ssl", "sha256", "-q", "--resume", "state_test", "--save-state", "state_test:12"], "abcdef") == hashlib.sha256(b"0123456789abcdef").hexdigest()
+        assert run_args(["./ft_ssl", "sha256", "-q", "--resume", "state_test"], "cdef") == hashlib.sha256(b"0123456789abcdef").hexdigest()
+        os.remove("state_test")
+        # instrumentation, on stderr only
+        with open("file", "w") as f:
+            f.write("And above all,\n")
+        report = run_args(["./ft_ssl", "md5", "--stats", "file"]).split("\n")
+        assert report[0].startswith("ft_ssl: stats: file: 15 bytes in ") and report[1] == "MD5 (file) = 53d53ea94217b259c11a5a2d104ec58a"
+        assert report[2].startswith("ft_ssl: stats: 1 files, 15 bytes in ") and report[4].startswith("ft_ssl: stats: time: read ")
+        assert report[3] == "ft_ssl: stats: syscalls: 1 open, 2 read, 0 mmap, 1 write"
+        p = subprocess.run(["./ft_ssl", "md5", "-q", "--stats", "file"], capture_output=True)
+        assert p.stdout == b"53d53ea94217b259c11a5a2d104ec58a\n" and b"1 files" in p.stderr
+        # several files share the lanes of the multi-buffer kernel, with io_uring or read()
+        with open("file2", "wb") as f:
+            f.write(os.urandom(100000))
+        for uring in ("1", "0"):
+            p = subprocess.run(["./ft_ssl", "sha256", "-q", "--stats", "file", "file2"], capture_output=True, env={**os.environ, "FT_SSL_URING": uring})
+            report = p.stderr.decode().split("\n")
+            assert sorted(line.split(" bytes in ")[0] for line in report[:2]) == ["ft_ssl: stats: file2: 100000", "ft_ssl: stats: file: 15"], report
+            assert report[2].startswith("ft_ssl: stats: 2 files, 100015 bytes in ") and report[3].startswith("ft_ssl: stats: syscalls: 2 open, ")
+            assert int(report[3].split(" open, ")[1].split(" read")[0]) >= 2, report
+        os.remove("file2")
+        assert run_exit_code(["./ft_ssl", "md5", "--stats", "--stats"]) != 0
+        # output is buffered, errors still come between the results around them
+        report = run_args(["./ft_ssl", "md5", "-q", "file", "missing_file", "file"])
+        assert report == "53d53ea94217b259c11a5a2d104ec58a\nft_ssl: file not found: 'missing_file'\n53d53ea94217b259c11a5a2d104ec58a"
+        # a mapped file that shrinks is a read error, not a SIGBUS
+        assert run_shrinking(["./ft_ssl", "md5", "-q"]) == (0, b"ft_ssl: failed to read file: 'shrinking'\n")
+        # also when the whole file is mapped for -t, its leaves hashed on workers or verified with -c
+        assert run_shrinking(["./ft_ssl", "sha256", "-q", "-t", "1M", "-j", "2"]) == (0, b"ft_ssl: failed to read file: 'shrinking'\n")
+        # built-in benchmark, as short as it gets
+        os.environ["FT_SSL_SPEED_MS"] = "1"
+        report = run_args(["./ft_ssl", "speed", "sha256", "-j", "2"])
+        assert report.startswith("SHA256\nkernel") and "\nunrolled       16 " in report and "16M" in report and "MD5" not in report
+        assert "\n      2       64K " in report
+        assert run_exit_code(["./ft_ssl", "speed", "sha1"]) != 0
+        assert run_exit_code(["./ft_ssl", "speed", "md5", "md5"]) != 0
+        assert run_exit_code(["./ft_ssl", "speed", "-j", "x"]) != 0
+        del os.environ["FT_SSL_SPEED_MS"]
         for i in range(1, 256):
             c = chr(i)
-            if c != "s" and c != "p" and c != "q" and c != "r" and c != ' ':
+            if c != "s" and c != "p" and c != "q" and c != "r" and c != "R" and c != ' ':
                 assert run_exit_code(["./ft_ssl", "md5", f"-{c}", "-s", "a"]) != 0, f"flag {c} worked"
                 assert run_exit_code(["./ft_ssl", "sha256", f"-{c}", "-s", "a"]) != 0, f"flag {c} worked"
+    elif selected_corpus == "lib": # python3 fuzz.py md5 text lib, needs make lib
+        import ctypes
+        lib = ctypes.CDLL("./libft_ssl.so")
+        size = 16 if args.alg == "md5" else 32
+        ctx_size = 88 if args.alg == "md5" else 104 # sizeof(t_md5_ctx), sizeof(t_sha256_ctx)
+        for n in list(range(0, 300)) + [random.randint(300, 100000) for _ in range(50)]:
+            data = os.urandom(n)
+            expected = hashlib.new(args.alg, data).digest()
+            out = ctypes.create_string_buffer(size)
+            getattr(lib, f"ft_{args.alg}")(data, n, out)
+            assert out.raw == expected, f"one-shot {n} bytes"
+            # the same bytes, fed in random pieces
+            ctx = ctypes.create_string_buffer(ctx_size)
+            getattr(lib, f"ft_{args.alg}_init")(ctx)
+            i = 0
+            while i < n:
+                piece = data[i:i + random.randint(0, 200)]
+                getattr(lib, f"ft_{args.alg}_update")(ctx, piece, len(piece))
+                i += len(piece)
+            getattr(lib, f"ft_{args.alg}_final")(ctx, out)
+            assert out.raw == expected, f"streaming {n} bytes"
+    elif selected_corpus == "bench": # python3 fuzz.py md5 text bench, needs make ft_ssl_bench
+        import json
+        sys.path.insert(0, "bench")
+        from compare import compare
+        report = json.loads(run_args(["./ft_ssl_bench", "--json"]))
+        names = [r["name"] for r in report["results"]]
+        for name in ("ctx_chomp", "ctx_hexdigest", "file"):
+            assert f"{name}/{args.alg.upper()}" in names, f"{name} missing from the report"
+        assert any(n.startswith(f"{args.alg}_digest/") for n in names)
+        assert all(r["value"] > 0 for r in report["results"])
+        if os.path.exists("bench/baseline.json"):
+            with open("bench/baseline.json") as f:
+                regressions = compare(json.load(f), report, float(os.environ.get("BENCH_THRESHOLD", 10)))
+            assert not regressions, f"slower than the baseline: {', '.join(regressions)}"
+    elif selected_corpus == "serve": # python3 fuzz.py md5 text serve
+        import socket
+        import struct
+        import signal
+        path = f"/tmp/ft_ssl_{uuid4()}.sock"
+        alg = 0 if args.alg == "md5" else 1
+        size = 16 if args.alg == "md5" else 32
+
+        def connect() -> socket.socket:
+            s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            s.connect(path)
+            return s
+
+        def start_server(cpu: str) -> subprocess.Popen:
+            server = subprocess.Popen(["./ft_ssl", "serve", "--socket", path], env={**os.environ, "FT_SSL_CPU": cpu})
+            for _ in range(500):
+                try:
+                    connect().close()
+                    break
+                except OSError:
+                    time.sleep(0.01)
+            return server
+
+        def request(kind: int, payload: bytes = b"", raw: bool = False) -> bytes:
+            return struct.pack("<BBBBI", alg, kind, 1 if raw else 0, 0, len(payload)) + payload
+
+        def answer(s: socket.socket) -> Tuple[int, bytes]:
+            head = s.recv(2, socket.MSG_WAITALL)
+            body = s.recv(head[1], socket.MSG_WAITALL) if head[1] > 0 else b""
+            return head[0], body
+
+        def expected(data: bytes, raw: bool = False) -> bytes:
+            digest = hashlib.new(args.alg, data)
+            return digest.digest() if raw else digest.hexdigest().encode()
+
+        def client(messages: list):
+            s = connect()
+            # everything at once, the answers have to come back in order
+            s.sendall(b"".join(request(0, m, i % 2 == 1) for i, m in enumerate(messages)))
+            for i, m in enumerate(messages):
+                assert answer(s) == (1, expected(m, i % 2 == 1)), f"inline {len(m)} bytes"
+            s.close()
+
+        # "0": no multi-buffer kernel, every request on its own
+        for cpu in ("ff", "0"):
+            server = start_server(cpu)
+            client([os.urandom(n) for n in list(range(0, 300)) + [1024 * 1024, 100000]])
+            threads = [Thread(target=client, args=([os.urandom(random.randint(0, 2000)) for _ in range(200)],)) for _ in range(8)]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            with open("file", "wb") as f:
+                f.write(os.urandom(100000))
+            with open("file", "rb") as f:
+                data = f.read()
+            s = connect()
+            s.sendall(request(1, b"file") + request(1, b"missing_file", True))
+            assert answer(s) == (1, expected(data))
+            assert answer(s) == (2, b"")
+            with open("file", "rb") as f:
+                socket.send_fds(s, [request(2, raw=True)], [f.fileno()])
+            assert answer(s) == (1, expected(data, True))
+            # a FIFO or a pipe would block the loop, turned down without reading
+            fifo = f"/tmp/ft_ssl_{uuid4()}.fifo"
+            os.mkfifo(fifo)
+            r, w = os.pipe()
+            s.sendall(request(1, fifo.encode()))
+            assert answer(s) == (3, b"")
+            socket.send_fds(s, [request(2)], [r])
+            assert answer(s) == (3, b"")
+            client([b"abc"])
+            os.close(r)
+            os.close(w)
+            os.unlink(fifo)
+            # a bad header ends the connection
+            s.sendall(request(0, b"a") + struct.pack("<BBBBI", 7, 0, 0, 0, 0))
+            assert answer(s) == (1, expected(b"a"))
+            assert answer(s) == (4, b"")
+            assert s.recv(1) == b""
+            s.close()
+            s = connect()
+            # too large, turned down from the header alone
+            s.sendall(struct.pack("<BBBBI", alg, 0, 0, 0, 1024 * 1024 + 1))
+            assert answer(s) == (4, b"")
+            s.close()
+            server.send_signal(signal.SIGTERM)
+            assert server.wait() == 0
+            assert not os.path.exists(path), "socket left behind"
+        # a socket left by a killed server is replaced, a live one isn't
+        server = start_server("ff")
+        assert run_exit_code(["./ft_ssl", "serve", "--socket", path]) != 0
+        server.kill()
+        server.wait()
+        server = start_server("ff")
+        client([b"abc"])
+        server.send_signal(signal.SIGTERM)
+        assert server.wait() == 0
+        assert run_exit_code(["./ft_ssl", "serve"]) != 0
+        assert run_exit_code(["./ft_ssl", "serve", "--socket", "/nonexistent/dir/sock"]) != 0
     else:
         print("[!] unknown corpus", selected_corpus)
         exit(1)
\ No newline at end of file
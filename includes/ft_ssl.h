@@ -13,14 +13,36 @@
 #define ERR_DUPLICATE_FLAG "flag specified twice"
 #define ERR_FILE_NOT_FOUND "file not found"
 #define ERR_FILE_READ_FAILED "failed to read file"
+#define ERR_INVALID_JOBS "invalid number of jobs"
+#define ERR_INVALID_ALGORITHM "invalid algorithm"
+#define ERR_INVALID_CHUNK_SIZE "invalid chunk size"
+#define ERR_CACHE_UNAVAILABLE "cache not available"
+#define ERR_INVALID_STATE "invalid state file"
+#define ERR_STATE_WRITE_FAILED "failed to write state file"
+#define ERR_STATE_PAST_END "saved state goes past the end of the file"
+#define ERR_INVALID_BYTE_COUNT "invalid byte count"
+#define ERR_STATE_OFFSET "no state to save at that byte count"
+#define ERR_PATH_TOO_LONG "path too long in the list"
+#define ERR_SOCKET_FAILED "failed to listen on socket"
+#define ERR_INVALID_ITERATIONS "invalid number of iterations"
+#define ERR_INVALID_KEY_LENGTH "invalid key length"
+#define ERR_NO_PASSWORD "no password to derive a key from"
 
 // Crypto constants
 #define MAX_DIGEST_SIZE 32 // SHA-256
-#define BUFFER_SIZE 16384 // will chomp 16384 bytes at a time
+#define BUFFER_SIZE 16384 // will read 16384 bytes at a time
+#define BLOCK_SIZE 64 // MD5 and SHA-256 both work on 512-bit blocks
+#define MMAP_WINDOW (64 * 1024 * 1024) // regular files are mapped 64 MiB at a time
+#define MMAP_MIN_SIZE BUFFER_SIZE // smaller files take a single read(), cheaper than mapping them
+#define PIPE_DEPTH 4 // buffers read ahead by the reader thread of a stream
+#define PIPE_BUFFER_SIZE 65536 // a full pipe, by default
+#define MULTI_CHUNK 32768 // bytes hashed by every algorithm in turn, small enough to stay in L1 / L2
 
 // Helper macros
 #define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
 #define RIGHTROTATE(x, c) (((x) >> (c)) | ((x) << (32 - (c))))
+#define LOAD_LE32(p) ((u32) (p)[0] | ((u32) (p)[1] << 8) | ((u32) (p)[2] << 16) | ((u32) (p)[3] << 24))
+#define LOAD_BE32(p) (((u32) (p)[0] << 24) | ((u32) (p)[1] << 16) | ((u32) (p)[2] << 8) | (u32) (p)[3])
 #define IS_SET(flags, flag) ((flags & flag) == flag)
 #define SET_FLAG(flags, flag) (flags |= flag)
 #define UNSET_FLAG(flags, flag) (flags &= ~flag)
@@ -32,13 +54,28 @@
 #define FLAG_S          0b00001000
 #define FLAG_ALG_MD5    0b10000000
 #define FLAG_ALG_SHA256 0b01000000
+#define FLAG_ALG_MULTI  0b00100000
 
 // forward declaration
 struct s_context;
 
-typedef void (*digest_func)(struct s_context *ctx);
+typedef void (*digest_func)(byte *digest, const byte *blocks, u64 nblocks);
 typedef void (*final_func)(struct s_context *ctx);
 typedef void (*reset_func)(struct s_context *ctx);
+typedef void (*pad_func)(struct s_context *ctx);
+typedef void (*output_func)(struct s_context *ctx);
+typedef void (*mb_digest_func)(byte **digests, const byte **data, u64 nblocks);
+
+/**
+ * Multi-buffer implementations of a digest function, they compress the same number of blocks
+ * of up to `lanes` independent messages at once, one message per SIMD lane.
+*/
+typedef struct s_mb_kernel {
+    char *name;                         // Name of the implementation
+    u32 cpu_flags;                      // CPU_* extensions required to run it
+    u8 lanes;                           // Number of messages hashed side by side
+    mb_digest_func digest_fn;           // The digest function itself
+} t_mb_kernel;
 
 /*
     A context is a structure that holds the state of the hash function.
@@ -48,17 +85,20 @@ typedef void (*reset_func)(struct s_context *ctx);
     - The finalization function
     - The digest (the final hash value)
     - The size of the digest (MD5 is 16 bqytes long, SHA-256 is 32 bytes long)
-    - The buffer (the buffer that holds the input)
+    - The buffer (the bytes that don't fill a whole block yet, the rest is compressed straight from the caller's buffer)
 */
 
 typedef struct s_context {
     u64 chomped_bytes;                  // The number of bytes that have been processed
-    digest_func digest_fn;              // The function that consumes N bytes of the internal buffer
+    digest_func digest_fn;              // The function that compresses N blocks into the digest
     final_func final_fn;                // The finalization function
     reset_func reset_fn;                // The reset function
+    pad_func pad_fn;                    // Appends the padding and the message length to the buffer
+    output_func output_fn;              // Turns the state into the final hash value after the last digest, NULL if nothing to do
+    const t_mb_kernel *mb_kernel;       // Multi-buffer digest function, NULL if the CPU has none
     byte digest[MAX_DIGEST_SIZE * 4];   // The final hash value -> will be initialized depending on the hash function
     u8 digest_size;                     // The size of the digest, we have to know it to not overflow the digest buffer :^)
-    byte buffer[BUFFER_SIZE+128];       // The buffer that holds the input + space for padding
+    byte buffer[BLOCK_SIZE * 2];        // The last incomplete block + space for padding
     u16 buffer_size;                    // Number of bytes in the buffer
     u64 known_size;                     // Total size of the input, 0 if unknown
     bool stream_finished;               // True if the stream has been finished (no more input)
@@ -67,6 +107,17 @@ typedef struct s_context {
 
 typedef t_context (*init_func)(u64);
 
+/**
+ * Some hash functions have several implementations of their digest function (scalar, SHA-NI, ...).
+ * They are listed in a NULL-terminated table, from the fastest to the slowest, and the first one
+ * whose CPU requirements are met is picked at runtime, so a single binary runs everywhere.
+*/
+typedef struct s_kernel {
+    char *name;                         // Name of the implementation
+    u32 cpu_flags;                      // CPU_* extensions required to run it
+    digest_func digest_fn;              // The digest function itself
+} t_kernel;
+
 
 /**
  * The subject specifies that the program should be able to handle multiple algorithms.
@@ -80,24 +131,245 @@ typedef struct s_algorithm {
     u8 flag;
 } t_algorithm;
 
+// CPU features (runtime dispatch)
+#define CPU_SSE2        0b00000001
+#define CPU_SSSE3       0b00000010
+#define CPU_SSE41       0b00000100
+#define CPU_AVX2        0b00001000
+#define CPU_AVX512F     0b00010000
+#define CPU_SHA         0b00100000
+
+u32 cpu_features(void);
+const t_kernel *kernel_select(const t_kernel *kernels);
+const t_mb_kernel *mb_kernel_select(const t_mb_kernel *kernels);
+u64 cpu_cycles(void);
+
+// Hex encoding / decoding, see hex.c
+typedef void (*hex_encode_func)(const byte *in, char *out, u64 size);
+typedef bool (*hex_decode_func)(const char *hex, byte *out, u64 size);
+
+/**
+ * Implementations of the hex encoder and decoder, picked like the digest kernels
+*/
+typedef struct s_hex_kernel {
+    char *name;                         // Name of the implementation
+    u32 cpu_flags;                      // CPU_* extensions required to run it
+    hex_encode_func encode_fn;          // Bytes to lowercase hex
+    hex_decode_func decode_fn;          // Hex (any case) to bytes, false on a non-hex character
+} t_hex_kernel;
+
+const t_hex_kernel *hex_kernels(void);
+void hex_encode(const byte *in, char *out, u64 size);
+bool hex_decode(const char *hex, byte *out, u64 size);
+
 // Bit utils functions
 void to_bytes(u32 n, byte *output);
 u32 to_u32(const byte *bytes);
 
 // Generic functions / stuff
 void ctx_chomp(t_context *ctx, const byte *buf, u64 n);
+void ctx_chomp_all(t_context *ctxs, i32 count, const byte *buf, u64 n);
+bool ctx_chomp_fd(t_context *ctxs, i32 count, i32 fd);
+i64 ctx_chomp_fd_prefix(t_context *ctxs, i32 count, i32 fd, u64 n);
+bool map_guard(void (*fn)(void *), void *arg);
 void ctx_finish(t_context *ctx);
 void ctx_hexdigest(t_context *ctx, unsigned char *out);
 void ctx_print_digest(t_context *ctx, char *arg, bool is_file, u8 flags);
 
+// Status of a file hashed in the background (multi-buffer lanes, thread pool)
+#define FILE_PENDING        0
+#define FILE_DONE           1
+#define FILE_NOT_FOUND      2
+#define FILE_READ_FAILED    3
+
+// Multi-buffer hashing
+#define MB_MAX_LANES 16
+#define MB_WINDOW 1024 // max number of digests waiting to be printed
+#define MB_FEW_LANES(active, lanes) ((active) * 4 <= (lanes)) // most lanes would be idle, the single-buffer kernel is faster
+
+bool mb_hash_files(t_context *ctx, char **paths, i32 count, u8 flags);
+
+// Reader / hasher pipeline for streams
+u32 pipeline_depth(void);
+bool pipeline_chomp_fd(t_context *ctxs, i32 count, i32 fd, u32 depth, bool *ok);
+
+// Thread pool hashing
+bool pool_hash_files(t_context *ctx, char **paths, i32 count, u8 flags, i32 jobs);
+
+// Recursive hashing (-R), see walk.c
+#define WALK_DENTS_SIZE 32768 // bytes of directory entries read at a time
+
+bool walk_hash_paths(t_context *ctx, char **paths, i32 count, u8 flags, i32 jobs);
+
+// Tree hashing (-t), see tree.c
+#define TREE_MIN_CHUNK 1024
+#define TREE_MAX_CHUNK (1024 * 1024 * 1024)
+
+bool tree_hash_buffer(t_context *ctx, const byte *data, u64 size, u64 chunk, i32 jobs);
+bool tree_hash_fd(t_context *ctx, i32 fd, u64 chunk, i32 jobs);
+void tree_alg_name(t_context *ctx, u64 chunk);
+
+// Asynchronous reads (io_uring), see uring.c
+typedef struct s_uring {
+    i32 fd;                             // Ring file descriptor, -1 if io_uring is not available
+    void *sq_ring;                      // Submission queue ring (shared with the kernel)
+    void *cq_ring;                      // Completion queue ring, may be the same mapping
+    void *sqes;                         // Submission queue entries
+    void *cqes;                         // Completion queue entries, inside cq_ring
+    u64 sq_ring_size;                   // Sizes of the mappings
+    u64 cq_ring_size;
+    u64 sqes_size;
+    u32 *sq_tail;                       // Pointers to the fields of the rings
+    u32 *sq_mask;
+    u32 *sq_array;
+    u32 *cq_head;
+    u32 *cq_tail;
+    u32 *cq_mask;
+    u32 to_submit;                      // Number of reads queued but not submitted yet
+    bool fixed;                         // True if the buffers are registered
+} t_uring;
+
+bool uring_init(t_uring *ring, u32 entries, byte **buffers, u32 count, u32 size);
+void uring_destroy(t_uring *ring);
+void uring_read(t_uring *ring, i32 fd, byte *buf, u32 len, u64 offset, u16 buf_index, u64 user_data);
+bool uring_wait(t_uring *ring, u64 *user_data, i32 *res);
+
 // hehe funny ft functions :^)
 i32 ft_strlen(const char *s);
 i32 ft_strcmp(const char *s1, const char *s2);
 void *ft_memcpy(void *dest, const void *src, u64 n);
+void *ft_memset(void *dest, i32 c, u64 n);
+i32 ft_memcmp(const void *s1, const void *s2, u64 n);
 i64 ft_putstr_fd(i32 fd, const void *s, i64 len);
+i64 ft_putnbr_fd(i32 fd, u64 n);
+i64 ft_putfloat_fd(i32 fd, f64 n, i32 decimals, i32 width);
+i32 ft_nbrtostr(char *dest, u64 n);
+i32 ft_floattostr(char *dest, f64 n, i32 decimals, i32 width);
+
+// Buffered standard output, see output.c
+#define OUTPUT_BUFFER_SIZE 65536 // written to stdout when full, before an error and at exit
+
+void output_write(const void *s, i64 len);
+void output_hex(const byte *in, u64 size);
+void output_flush(void);
 
 // Argument parsing
-i32 parse_parameters(int argc, char **argv, u8* flags);
+#define MAX_JOBS 1024
+#define MULTI_COMMAND "multi" // hashes every input with several algorithms (-a)
+#define MULTI_MAX_ALGORITHMS 8 // max number of algorithms of the multi command
+#define FILES_FROM_BUFFER 65536 // paths of --files-from are read and hashed this many bytes at a time
+
+/**
+ * Options that come with a value, unlike the flags
+*/
+typedef struct s_options {
+    i32 jobs;                           // Number of threads hashing files (-j), 0 if not set
+    char *algorithms;                   // Comma-separated algorithms of the multi command (-a), NULL if not set
+    u64 tree_chunk;                     // Chunk size of tree hashing (-t), 0 if not set
+    char *manifest;                     // Manifest to verify (-c), NULL if not set
+    char *save_state;                   // Where to save the state before finalizing (--save-state), NULL if not set
+    u64 save_at;                        // Number of bytes hashed when the state is saved (--save-state FILE:N), 0 at the end
+    char *resume;                       // State to resume from (--resume), NULL if not set
+    bool stats;                         // Print timings and counters to stderr at exit (--stats)
+    bool recursive;                     // Hash the regular files under directories (-R)
+    char *files_from;                   // File listing the paths to hash, "-" for stdin (--files-from), NULL if not set
+    bool null_delimited;                // Paths of --files-from end with a NUL byte instead of a newline (-0)
+} t_options;
+
+i32 default_jobs(void);
+bool parse_jobs(char *value, t_options *options);
+bool parse_chunk_size(char *value, t_options *options);
+bool parse_save_state(char *value, t_options *options);
+
+// Persistent digest cache (FT_SSL_CACHE), see cache.c
+#define CACHE_COMMAND "cache" // cache stats|clear
+
+/**
+ * What identifies an unchanged file, with the algorithm its digest was computed with
+*/
+typedef struct s_cache_key {
+    u64 dev;                            // st_dev
+    u64 ino;                            // st_ino
+    u64 size;                           // st_size
+    u64 mtime_sec;                      // st_mtim
+    u64 mtime_nsec;
+    u8 alg;                             // FLAG_ALG_*, 0 if the file can't be cached
+} t_cache_key;
+
+bool cache_init(void);
+bool cache_enabled(void);
+bool cache_lookup(const char *path, u8 alg, byte *digest, u8 size, t_cache_key *key);
+void cache_store(const t_cache_key *key, i32 fd, const byte *digest, u8 size);
+int cache_command(int argc, char **argv);
+
+// Built-in benchmark, see speed.c
+#define SPEED_COMMAND "speed" // speed [md5|sha256] [-j N]
+
+int speed_command(int argc, char **argv);
+
+// Serve command, see serve.c
+#define SERVE_COMMAND "serve" // serve --socket PATH
+
+int serve_command(int argc, char **argv);
+
+// HMAC commands, see hmac.c
+#define HMAC_MD5_COMMAND "hmac-md5" // hmac-md5 -k KEY [-q] [-r] [--lines | -s STRING | files...]
+#define HMAC_SHA256_COMMAND "hmac-sha256"
+
+typedef struct s_hmac {
+    t_context inner;                    // State after the key ^ ipad block, cloned for every message
+    t_context outer;                    // State after the key ^ opad block
+} t_hmac;
+
+void hmac_init(t_hmac *hmac, init_func init, const byte *key, u64 key_size);
+void hmac_start(const t_hmac *hmac, t_context *ctx);
+void hmac_final(const t_hmac *hmac, t_context *ctx);
+int hmac_command(int argc, char **argv);
+
+// PBKDF2-HMAC-SHA256 command, see pbkdf2.c
+#define PBKDF2_COMMAND "pbkdf2" // pbkdf2 -s SALT -i ITERATIONS [-l LENGTH] [-j N] [-p PASSWORD]
+
+int pbkdf2_command(int argc, char **argv);
+
+// Instrumentation (--stats), see stats.c
+#define STATS_READ          0 // open(), read(), mmap() of the inputs
+#define STATS_COPY          1 // bytes copied into the context buffer
+#define STATS_DIGEST        2 // compression function
+#define STATS_FINAL         3 // padding and last blocks
+#define STATS_OUTPUT        4 // formatting and writing the results
+#define STATS_PHASES        5
+
+#define STATS_OPENS         0
+#define STATS_READS         1
+#define STATS_MAPS          2
+#define STATS_WRITES        3
+#define STATS_BYTES         4 // bytes fed to the hash functions
+#define STATS_FILES         5
+#define STATS_COUNTERS      6
+
+extern bool stats_enabled;
+
+// Free without --stats: the branch is always predicted, the timer isn't read
+#define STATS_START() (__builtin_expect(stats_enabled, false) ? stats_ticks() : 0)
+#define STATS_STOP(phase, start) do { if (__builtin_expect(stats_enabled, false)) { stats_phase(phase, start); } } while (0)
+#define STATS_COUNT(counter, n) do { if (__builtin_expect(stats_enabled, false)) { stats_count(counter, n); } } while (0)
+
+void stats_init(void);
+u64 stats_ticks(void);
+void stats_phase(u8 phase, u64 start);
+void stats_count(u8 counter, u64 n);
+void stats_file(const char *path, u64 bytes, u64 start);
+
+// Saved hash states (--save-state, --resume), see state.c
+bool state_save(const t_context *ctx, const char *path);
+bool state_load(t_context *ctx, const char *path);
+
+// Manifest verification (-c), see check.c
+#define CHECK_WINDOW 256 // max number of entries being hashed or waiting to be printed
+#define CHECK_LINE_MAX 4352 // a PATH_MAX path, its digest and the algorithm name
+
+bool check_manifest(t_context *ctx, char *path, u8 flags, const t_options *options);
+i32 parse_parameters(int argc, char **argv, u8* flags, t_options *options);
 
 // Error management
 void print_error(const char *error_message, char *details);
@@ -109,6 +381,18 @@ void print_error(const char *error_message, char *details);
 
 t_context md5_init(u64 known_size);
 void md5_final(t_context *ctx);
+void md5_pad(t_context *ctx);
+void md5_digest(byte *digest, const byte *blocks, u64 nblocks);
+void md5_digest_unrolled(byte *digest, const byte *blocks, u64 nblocks);
+const t_kernel *md5_kernels(void);
+extern const u32 md5_s[64];
+extern const u32 md5_k[64];
+extern const u32 md5_initial_digest[MD5_DIGEST_SIZE / 4];
+const t_mb_kernel *md5_mb_kernel(void);
+const t_mb_kernel *md5_mb_kernels(void);
+void md5_x4_sse2(byte **digests, const byte **data, u64 nblocks);
+void md5_x8_avx2(byte **digests, const byte **data, u64 nblocks);
+void md5_x16_avx512(byte **digests, const byte **data, u64 nblocks);
 void md5(const byte *initial_msg, size_t initial_len, byte *digest);
 
 // SHA-256 functions / stuff
@@ -116,4 +400,18 @@ void md5(const byte *initial_msg, size_t initial_len, byte *digest);
 #define SHA256_DIGEST_SIZE 32
 #define SHA256_ALG_NAME "SHA256"
 
-t_context sha256_init(u64 known_size);
\ No newline at end of file
+extern const u32 sha256_k[64];
+extern const u32 sha256_initial_digest[SHA256_DIGEST_SIZE / 4];
+
+t_context sha256_init(u64 known_size);
+void sha256_final(t_context *ctx);
+void sha256_pad(t_context *ctx);
+void sha256_output(t_context *ctx);
+void sha256_digest(byte *digest, const byte *blocks, u64 nblocks);
+void sha256_digest_unrolled(byte *digest, const byte *blocks, u64 nblocks);
+const t_kernel *sha256_kernels(void);
+void sha256_ni_digest(byte *digest, const byte *blocks, u64 nblocks);
+const t_mb_kernel *sha256_mb_kernel(void);
+const t_mb_kernel *sha256_mb_kernels(void);
+void sha256_x8_avx2(byte **digests, const byte **data, u64 nblocks);
+void sha256_x16_avx512(byte **digests, const byte **data, u64 nblocks);
\ No newline at end of file
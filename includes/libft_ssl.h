@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Public API of libft_ssl.a / libft_ssl.so: MD5 and SHA-256, streaming or one-shot.
+ *
+ * Contexts are allocated by the caller (stack, struct member, ...), the library never allocates.
+ * A context only holds the state of its algorithm, the number of bytes hashed and one block.
+ * The fastest implementation the CPU supports is picked on first use, like ft_ssl does.
+ *
+ * Functions are thread-safe as long as a context isn't shared between threads.
+*/
+
+#define FT_SSL_API __attribute__((visibility("default")))
+
+#define FT_MD5_DIGEST_SIZE 16
+#define FT_SHA256_DIGEST_SIZE 32
+
+typedef struct s_md5_ctx {
+    uint32_t state[4];                  // Intermediate hash value
+    uint64_t length;                    // Number of bytes hashed so far
+    uint8_t block[64];                  // Incomplete block, length % 64 bytes
+} t_md5_ctx;
+
+typedef struct s_sha256_ctx {
+    uint32_t state[8];                  // Intermediate hash value
+    uint64_t length;                    // Number of bytes hashed so far
+    uint8_t block[64];                  // Incomplete block, length % 64 bytes
+} t_sha256_ctx;
+
+FT_SSL_API void ft_md5_init(t_md5_ctx *ctx);
+FT_SSL_API void ft_md5_update(t_md5_ctx *ctx, const void *data, size_t len);
+FT_SSL_API void ft_md5_final(t_md5_ctx *ctx, uint8_t out[FT_MD5_DIGEST_SIZE]);
+FT_SSL_API void ft_md5(const void *data, size_t len, uint8_t out[FT_MD5_DIGEST_SIZE]);
+
+FT_SSL_API void ft_sha256_init(t_sha256_ctx *ctx);
+FT_SSL_API void ft_sha256_update(t_sha256_ctx *ctx, const void *data, size_t len);
+FT_SSL_API void ft_sha256_final(t_sha256_ctx *ctx, uint8_t out[FT_SHA256_DIGEST_SIZE]);
+FT_SSL_API void ft_sha256(const void *data, size_t len, uint8_t out[FT_SHA256_DIGEST_SIZE]);
@@ -1,4 +1,5 @@
 #include "ft_ssl.h"
+#include <unistd.h>
 
 /**
  * @brief Parse the argument in the command line, and set the flags accordingly.
@@ -36,18 +37,240 @@ bool parse_arg(char *arg, u8 *flags) {
     return (true);
 }
 
+/**
+ * @brief Default number of threads: one per CPU, within 1..MAX_JOBS
+ */
+i32 default_jobs(void) {
+    i64 cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus < 1) {
+        return (1);
+    }
+    return (cpus < MAX_JOBS ? cpus : MAX_JOBS);
+}
+
+/**
+ * @brief Parses the value of -j, a number of threads, 0 meaning one per CPU
+ * 
+ * @param value Value of the option
+ * @param options Options to set
+ * @return true Value was parsed successfully
+ * @return false An error occurred
+ */
+bool parse_jobs(char *value, t_options *options) {
+    i64 jobs = 0;
+    if (options->jobs != 0) {
+        print_error(ERR_DUPLICATE_FLAG, "-j");
+        return (false);
+    }
+    if (value == NULL) {
+        print_error(ERR_INVALID_FLAG, "no number of jobs specified after -j");
+        return (false);
+    }
+    if (*value == '\0') {
+        print_error(ERR_INVALID_JOBS, value);
+        return (false);
+    }
+    for (i32 i = 0; value[i] != '\0'; i++) {
+        if (value[i] < '0' || value[i] > '9' || jobs > MAX_JOBS) {
+            print_error(ERR_INVALID_JOBS, value);
+            return (false);
+        }
+        jobs = jobs * 10 + value[i] - '0';
+    }
+    if (jobs == 0) {
+        jobs = default_jobs();
+    }
+    if (jobs > MAX_JOBS) {
+        print_error(ERR_INVALID_JOBS, value);
+        return (false);
+    }
+    options->jobs = jobs;
+    return (true);
+}
+
+/**
+ * @brief Parses the value of -t, a chunk size in bytes with an optional K, M or G suffix (powers of 1024)
+ * 
+ * @note The size must be a power of two between TREE_MIN_CHUNK and TREE_MAX_CHUNK
+ * 
+ * @param value Value of the option
+ * @param options Options to set
+ * @return true Value was parsed successfully
+ * @return false An error occurred
+ */
+bool parse_chunk_size(char *value, t_options *options) {
+    u64 size = 0;
+    i32 i = 0;
+    if (options->tree_chunk != 0) {
+        print_error(ERR_DUPLICATE_FLAG, "-t");
+        return (false);
+    }
+    if (value == NULL) {
+        print_error(ERR_INVALID_FLAG, "no chunk size specified after -t");
+        return (false);
+    }
+    for (; value[i] >= '0' && value[i] <= '9' && size <= TREE_MAX_CHUNK; i++) {
+        size = size * 10 + value[i] - '0';
+    }
+    if (i > 0 && value[i] != '\0' && value[i + 1] == '\0') {
+        switch (value[i++]) {
+            case 'k':
+            case 'K':
+                size *= 1024;
+                break;
+            case 'm':
+            case 'M':
+                size *= 1024 * 1024;
+                break;
+            case 'g':
+            case 'G':
+                size *= 1024 * 1024 * 1024;
+                break;
+            default:
+                i = 0;
+        }
+    }
+    if (i == 0 || value[i] != '\0' || size < TREE_MIN_CHUNK || size > TREE_MAX_CHUNK || (size & (size - 1)) != 0) {
+        print_error(ERR_INVALID_CHUNK_SIZE, value);
+        return (false);
+    }
+    options->tree_chunk = size;
+    return (true);
+}
+
+/**
+ * @brief Parses the value of --save-state, a path optionally followed by a byte count (FILE:N)
+ * 
+ * @note Only a colon followed by digits starts a byte count, other colons are part of the path.
+ * The colon is replaced by a null byte, leaving the path alone in value.
+ * 
+ * @param value Value of the option
+ * @param options Options to set
+ * @return true Value was parsed successfully
+ * @return false An error occurred
+ */
+bool parse_save_state(char *value, t_options *options) {
+    char *colon = NULL;
+    u64 count = 0;
+    i32 i = 0;
+
+    for (; value[i] != '\0'; i++) {
+        colon = value[i] == ':' ? value + i : colon;
+    }
+    if (colon == NULL) {
+        return (true);
+    }
+    // past 2^60 bytes (an exbibyte), stop counting: no file is that long
+    for (i = 1; colon[i] >= '0' && colon[i] <= '9'; i++) {
+        count = count <= (1ULL << 60) ? count * 10 + colon[i] - '0' : count;
+    }
+    if (i == 1 || colon[i] != '\0') {
+        return (true);
+    }
+    // 0 would mean the end of the input, and the path can't be empty
+    if (count == 0 || count > (1ULL << 60) || colon == value) {
+        print_error(ERR_INVALID_BYTE_COUNT, value);
+        return (false);
+    }
+    *colon = '\0';
+    options->save_at = count;
+    return (true);
+}
+
+/**
+ * @brief Returns the value of an option, either glued to the flag (-j8) or the next argument (-j 8)
+ * 
+ * @param argc Number of arguments
+ * @param argv All passed arguments
+ * @param i Index of the flag, moved to the value if it's the next argument
+ * @return char* Value, NULL if there is none
+ */
+static char *_option_value(int argc, char **argv, i32 *i) {
+    if (argv[*i][2] != '\0') {
+        return (argv[*i] + 2);
+    }
+    return (*i + 1 < argc ? argv[++(*i)] : NULL);
+}
+
 /**
  * @brief Sets the flags from the command line arguments
  * 
  * @param argc Number of arguments
  * @param argv All passed arguments
  * @param flags Pointer to the flags bitmask
+ * @param options Options with a value (-j, -t, -c, -a, --save-state, --resume, --files-from), --stats, -R and -0
  * @return i32 Number of parameters parsed
  */
-i32 parse_parameters(int argc, char **argv, u8* flags) {
+i32 parse_parameters(int argc, char **argv, u8* flags, t_options *options) {
     i32 parameters = 0;
     for (i32 i = 2; i < argc; i++) {
-        if (argv[i][0] == '-') {
+        if (ft_strcmp(argv[i], "--save-state") == 0 || ft_strcmp(argv[i], "--resume") == 0 || ft_strcmp(argv[i], "--files-from") == 0) {
+            char **option = argv[i][2] == 's' ? &options->save_state : argv[i][2] == 'r' ? &options->resume : &options->files_from;
+            if (i + 1 == argc) {
+                print_error(ERR_INVALID_FLAG, argv[i][2] == 's' ? "no file specified after --save-state"
+                    : argv[i][2] == 'r' ? "no file specified after --resume" : "no file specified after --files-from");
+                return (-1);
+            } else if (*option != NULL) {
+                print_error(ERR_DUPLICATE_FLAG, argv[i]);
+                return (-1);
+            }
+            *option = argv[++i];
+            if (option == &options->save_state && !parse_save_state(*option, options)) {
+                return (-1);
+            }
+            parameters += 2;
+        } else if (ft_strcmp(argv[i], "--stats") == 0) {
+            if (options->stats) {
+                print_error(ERR_DUPLICATE_FLAG, argv[i]);
+                return (-1);
+            }
+            options->stats = true;
+            parameters++;
+        } else if (ft_strcmp(argv[i], "-R") == 0 || ft_strcmp(argv[i], "-0") == 0) {
+            bool *option = argv[i][1] == 'R' ? &options->recursive : &options->null_delimited;
+            if (*option) {
+                print_error(ERR_DUPLICATE_FLAG, argv[i]);
+                return (-1);
+            }
+            *option = true;
+            parameters++;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'j') {
+            char *value = _option_value(argc, argv, &i);
+            if (!parse_jobs(value, options)) {
+                return (-1);
+            }
+            parameters += argv[i] == value ? 2 : 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 't') {
+            char *value = _option_value(argc, argv, &i);
+            if (!parse_chunk_size(value, options)) {
+                return (-1);
+            }
+            parameters += argv[i] == value ? 2 : 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'c') {
+            char *value = _option_value(argc, argv, &i);
+            if (value == NULL) {
+                print_error(ERR_INVALID_FLAG, "no manifest specified after -c");
+                return (-1);
+            } else if (options->manifest != NULL) {
+                print_error(ERR_DUPLICATE_FLAG, "-c");
+                return (-1);
+            }
+            options->manifest = value;
+            parameters += argv[i] == value ? 2 : 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'a' && IS_SET(*flags, FLAG_ALG_MULTI)) {
+            // the list is checked against the algorithms table by main
+            char *value = _option_value(argc, argv, &i);
+            if (value == NULL) {
+                print_error(ERR_INVALID_FLAG, "no algorithms specified after -a");
+                return (-1);
+            } else if (options->algorithms != NULL) {
+                print_error(ERR_DUPLICATE_FLAG, "-a");
+                return (-1);
+            }
+            options->algorithms = value;
+            parameters += argv[i] == value ? 2 : 1;
+        } else if (argv[i][0] == '-') {
             if (!parse_arg(argv[i], flags)) {
                 return (-1);
             } else if (argv[i][1] == 's') {
@@ -0,0 +1,251 @@
+#include "ft_ssl.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Persistent digest cache (FT_SSL_CACHE=path): an open-addressing hash table in a file mapped by
+ * every ft_ssl process, keyed by (st_dev, st_ino, st_size, st_mtim, algorithm). A file that hasn't
+ * changed since it was hashed is not read again.
+ *
+ * Processes share the mapping, so each entry is guarded by a sequence number: odd while a writer
+ * owns it, bumped to the next even value when it's done. Readers copy the entry and retry the next
+ * slot if the sequence number changed meanwhile, writers take an entry with a compare-and-swap.
+ * Clearing the cache bumps a generation number, entries of older generations are free slots, so
+ * the file is never truncated under another process.
+*/
+
+#define CACHE_MAGIC 0x3145484341435346ULL // "FSCACHE1", changes with the layout
+#define CACHE_ENTRIES 65536 // power of two
+#define CACHE_MAX_PROBE 16 // slots looked at before giving up / evicting
+#define CACHE_RACY_SECONDS 2 // files modified more recently than that aren't stored
+
+typedef struct s_cache_header {
+    u64 magic;
+    u32 generation;                     // Entries of another generation are free
+    u32 unused;
+    u64 hits;                           // Lookups that found the digest
+    u64 misses;                         // Lookups that didn't
+} t_cache_header;
+
+typedef struct s_cache_entry {
+    u32 seq;                            // Odd while being written
+    u32 generation;                     // Header generation + 1, 0 if never written
+    t_cache_key key;
+    byte digest[MAX_DIGEST_SIZE];
+} t_cache_entry;
+
+typedef struct s_cache {
+    t_cache_header *header;             // Start of the mapping, NULL if the cache is disabled
+    t_cache_entry *entries;             // CACHE_ENTRIES entries after the header
+} t_cache;
+
+static t_cache _cache = {NULL, NULL};
+
+#define CACHE_FILE_SIZE (sizeof(t_cache_header) + CACHE_ENTRIES * sizeof(t_cache_entry))
+
+/**
+ * @brief Maps the cache file named by FT_SSL_CACHE, creating it if needed
+ *
+ * @note Must be called before any thread is started, the cache stays disabled if anything fails
+ *
+ * @return true The cache is enabled
+ */
+bool cache_init(void) {
+    char *path = getenv("FT_SSL_CACHE");
+    struct stat st;
+    u64 zero = 0;
+    void *map;
+    i32 fd;
+
+    if (_cache.header != NULL) {
+        return (true);
+    } else if (path == NULL || *path == '\0' || (fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+        return (false);
+    }
+    // a new file is all zeroes: no magic yet, generation 0, every entry free. Other files are left alone
+    if (fstat(fd, &st) == -1 || (st.st_size == 0 && ftruncate(fd, CACHE_FILE_SIZE) == -1)
+        || (st.st_size != 0 && (u64) st.st_size < CACHE_FILE_SIZE)) {
+        close(fd);
+        return (false);
+    }
+    map = mmap(NULL, CACHE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return (false);
+    }
+    _cache.header = map;
+    __atomic_compare_exchange_n(&_cache.header->magic, &zero, CACHE_MAGIC, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&_cache.header->magic, __ATOMIC_ACQUIRE) != CACHE_MAGIC) { // not a cache file, or another layout
+        munmap(map, CACHE_FILE_SIZE);
+        _cache.header = NULL;
+        return (false);
+    }
+    _cache.entries = (t_cache_entry *) (_cache.header + 1);
+    return (true);
+}
+
+/**
+ * @return true The cache is enabled
+ */
+bool cache_enabled(void) {
+    return (_cache.header != NULL);
+}
+
+/**
+ * @brief Index of the first slot of a key (splitmix64 finalizer of its fields)
+ */
+static u64 _cache_slot(const t_cache_key *key) {
+    u64 h = key->dev ^ (key->ino * 0x9E3779B97F4A7C15ULL) ^ (key->size << 17) ^ key->mtime_sec ^ (key->mtime_nsec << 32) ^ key->alg;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return ((h ^ (h >> 31)) & (CACHE_ENTRIES - 1));
+}
+
+static bool _cache_key_equal(const t_cache_key *a, const t_cache_key *b) {
+    return (a->dev == b->dev && a->ino == b->ino && a->size == b->size
+        && a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec && a->alg == b->alg);
+}
+
+static void _cache_key_from_stat(t_cache_key *key, const struct stat *st, u8 alg) {
+    ft_memset(key, 0, sizeof(t_cache_key));
+    key->dev = st->st_dev;
+    key->ino = st->st_ino;
+    key->size = st->st_size;
+    key->mtime_sec = st->st_mtim.tv_sec;
+    key->mtime_nsec = st->st_mtim.tv_nsec;
+    key->alg = alg;
+}
+
+/**
+ * @brief Looks a file up in the cache
+ *
+ * @param path Path to the file, not opened
+ * @param alg FLAG_ALG_* of the algorithm
+ * @param digest Set to the cached digest on a hit, size bytes
+ * @param size Size of the digest
+ * @param key Set to the key of the file, for cache_store, alg is 0 if the file can't be cached
+ * @return true Hit, false otherwise
+ */
+bool cache_lookup(const char *path, u8 alg, byte *digest, u8 size, t_cache_key *key) {
+    t_cache_entry copy;
+    struct stat st;
+    u32 generation, seq;
+
+    key->alg = 0;
+    if (_cache.header == NULL || stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return (false);
+    }
+    _cache_key_from_stat(key, &st, alg);
+    generation = __atomic_load_n(&_cache.header->generation, __ATOMIC_ACQUIRE) + 1;
+    for (u64 i = 0, slot = _cache_slot(key); i < CACHE_MAX_PROBE; i++, slot = (slot + 1) & (CACHE_ENTRIES - 1)) {
+        t_cache_entry *entry = &_cache.entries[slot];
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        ft_memcpy(&copy, entry, sizeof(t_cache_entry));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq % 2 == 1 || __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq) {
+            continue; // being written, might be ours but it's not there yet
+        } else if (copy.generation != generation) {
+            break; // slots are filled in probe order, a free one ends the chain
+        } else if (_cache_key_equal(&copy.key, key)) {
+            ft_memcpy(digest, copy.digest, size);
+            __atomic_fetch_add(&_cache.header->hits, 1, __ATOMIC_RELAXED);
+            return (true);
+        }
+    }
+    __atomic_fetch_add(&_cache.header->misses, 1, __ATOMIC_RELAXED);
+    return (false);
+}
+
+/**
+ * @brief Stores the digest of a file that has just been hashed
+ *
+ * @note Nothing is stored if the file changed since cache_lookup, or if it was modified in the
+ * last CACHE_RACY_SECONDS: a write in the same timestamp tick wouldn't change the key.
+ *
+ * @param key Key from cache_lookup
+ * @param fd The file, after hashing
+ * @param digest Digest of the file
+ * @param size Size of the digest
+ */
+void cache_store(const t_cache_key *key, i32 fd, const byte *digest, u8 size) {
+    t_cache_key after;
+    struct stat st;
+    struct timespec now;
+    u32 generation, seq;
+
+    if (_cache.header == NULL || key->alg == 0 || fstat(fd, &st) == -1 || clock_gettime(CLOCK_REALTIME, &now) == -1) {
+        return ;
+    }
+    _cache_key_from_stat(&after, &st, key->alg);
+    if (!_cache_key_equal(&after, key) || now.tv_sec - (i64) key->mtime_sec < CACHE_RACY_SECONDS) {
+        return ;
+    }
+    generation = __atomic_load_n(&_cache.header->generation, __ATOMIC_ACQUIRE) + 1;
+    u64 first = _cache_slot(key);
+    t_cache_entry *entry = NULL;
+    for (u64 i = 0, slot = first; i < CACHE_MAX_PROBE; i++, slot = (slot + 1) & (CACHE_ENTRIES - 1)) {
+        t_cache_entry *candidate = &_cache.entries[slot];
+        seq = __atomic_load_n(&candidate->seq, __ATOMIC_ACQUIRE);
+        if (seq % 2 == 0 && (candidate->generation != generation || _cache_key_equal(&candidate->key, key))) {
+            entry = candidate;
+            break;
+        }
+    }
+    // the chain is full, evict its first entry
+    if (entry == NULL) {
+        entry = &_cache.entries[first];
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    }
+    if (seq % 2 == 1 || !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return ; // another process is writing it
+    }
+    entry->key = *key;
+    ft_memcpy(entry->digest, digest, size);
+    entry->generation = generation;
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief The cache command: "stats" prints the number of entries and the hit rate, "clear" empties it
+ *
+ * @param argc Number of arguments
+ * @param argv All passed arguments, argv[2] is the action
+ * @return int Exit code
+ */
+int cache_command(int argc, char **argv) {
+    if (argc != 3 || (ft_strcmp(argv[2], "stats") != 0 && ft_strcmp(argv[2], "clear") != 0)) {
+        print_error(ERR_INVALID_FLAG, "usage: cache stats|clear");
+        return (1);
+    } else if (!cache_init()) {
+        print_error(ERR_CACHE_UNAVAILABLE, getenv("FT_SSL_CACHE") != NULL ? getenv("FT_SSL_CACHE") : "FT_SSL_CACHE is not set");
+        return (1);
+    }
+    if (ft_strcmp(argv[2], "clear") == 0) {
+        __atomic_fetch_add(&_cache.header->generation, 1, __ATOMIC_ACQ_REL);
+        __atomic_store_n(&_cache.header->hits, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&_cache.header->misses, 0, __ATOMIC_RELAXED);
+        return (0);
+    }
+    u32 generation = __atomic_load_n(&_cache.header->generation, __ATOMIC_ACQUIRE) + 1;
+    u64 hits = __atomic_load_n(&_cache.header->hits, __ATOMIC_RELAXED);
+    u64 misses = __atomic_load_n(&_cache.header->misses, __ATOMIC_RELAXED);
+    u64 used = 0;
+    for (u64 i = 0; i < CACHE_ENTRIES; i++) {
+        used += _cache.entries[i].generation == generation;
+    }
+    ft_putstr_fd(1, "entries: ", 9);
+    ft_putnbr_fd(1, used);
+    ft_putstr_fd(1, "/", 1);
+    ft_putnbr_fd(1, CACHE_ENTRIES);
+    ft_putstr_fd(1, "\nhits: ", 7);
+    ft_putnbr_fd(1, hits);
+    ft_putstr_fd(1, "\nmisses: ", 9);
+    ft_putnbr_fd(1, misses);
+    ft_putstr_fd(1, "\nhit rate: ", 11);
+    ft_putnbr_fd(1, hits + misses > 0 ? hits * 100 / (hits + misses) : 0);
+    ft_putstr_fd(1, "%\n", 2);
+    return (0);
+}
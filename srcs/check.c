@@ -0,0 +1,303 @@
+#include "ft_ssl.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Manifest verification (-c): the manifest is read line by line, in both formats printed by
+ * ctx_print_digest, "ALG (file) = hex" and "hex file" (-r). Every entry goes into a window of
+ * CHECK_WINDOW slots hashed by a pool of workers, the main thread keeps on parsing while they
+ * work and prints the results in the order of the manifest, so millions of lines only ever
+ * take CHECK_WINDOW slots of memory.
+*/
+
+typedef struct s_check_entry {
+    char path[CHECK_LINE_MAX];          // File to hash
+    byte expected[MAX_DIGEST_SIZE];     // Digest read from the manifest
+    u8 status;                          // FILE_* status of the file
+    bool match;                         // True if the digest is the expected one
+} t_check_entry;
+
+typedef struct s_check {
+    t_context ctx;                      // Template context of the algorithm
+    u64 tree_chunk;                     // Chunk size if tree hashing (-t), 0 otherwise
+    u8 alg;                             // FLAG_ALG_* of the context, to look files up in the cache
+    t_check_entry *entries;             // Ring of CHECK_WINDOW entries
+    u64 pushed;                         // Number of entries parsed so far
+    u64 taken;                          // Number of entries taken by a worker
+    u64 printed;                        // Number of entries printed, their slot is free
+    bool eof;                           // True once the whole manifest has been parsed
+    pthread_mutex_t lock;
+    pthread_cond_t work;                // Signaled when an entry is pushed, or at the end
+    pthread_cond_t done;                // Signaled when an entry has been hashed
+    u64 ok;                             // Counters of the summary
+    u64 failed;
+    u64 unreadable;
+    u64 malformed;
+} t_check;
+
+/**
+ * @brief Hashes the next entry not taken yet
+ *
+ * @param check Verification state
+ * @param ctx Context of the caller
+ * @param wait If true, waits for an entry to be pushed
+ * @return true An entry was hashed, false if there is none left
+ */
+static bool _check_next(t_check *check, t_context *ctx, bool wait) {
+    t_check_entry *entry;
+    u8 status = FILE_DONE;
+    t_cache_key key = {.alg = 0};
+    i32 fd;
+
+    pthread_mutex_lock(&check->lock);
+    while (wait && check->taken == check->pushed && !check->eof) {
+        pthread_cond_wait(&check->work, &check->lock);
+    }
+    if (check->taken == check->pushed) {
+        pthread_mutex_unlock(&check->lock);
+        return (false);
+    }
+    entry = &check->entries[check->taken++ % CHECK_WINDOW];
+    pthread_mutex_unlock(&check->lock);
+
+    // tree roots aren't cached
+    if (check->tree_chunk == 0 && cache_lookup(entry->path, check->alg, ctx->digest, ctx->digest_size, &key)) {
+        entry->match = ft_memcmp(ctx->digest, entry->expected, ctx->digest_size) == 0;
+    } else if ((fd = open(entry->path, O_RDONLY)) == -1) {
+        status = FILE_NOT_FOUND;
+    } else {
+        ctx->reset_fn(ctx);
+        if (check->tree_chunk != 0 ? tree_hash_fd(ctx, fd, check->tree_chunk, 1) : ctx_chomp_fd(ctx, 1, fd)) {
+            if (check->tree_chunk == 0) {
+                ctx->final_fn(ctx);
+                cache_store(&key, fd, ctx->digest, ctx->digest_size);
+            }
+            // raw bytes, the manifest's hex was decoded once when parsed
+            entry->match = ft_memcmp(ctx->digest, entry->expected, ctx->digest_size) == 0;
+        } else {
+            status = FILE_READ_FAILED;
+        }
+        close(fd);
+    }
+    pthread_mutex_lock(&check->lock);
+    entry->status = status;
+    pthread_cond_signal(&check->done);
+    pthread_mutex_unlock(&check->lock);
+    return (true);
+}
+
+static void *_check_worker(void *arg) {
+    t_check *check = arg;
+    t_context ctx = check->ctx;
+
+    while (_check_next(check, &ctx, true));
+    return (NULL);
+}
+
+/**
+ * @brief Prints the result of an entry, updates the counters
+ */
+static void _check_print(t_check *check, t_check_entry *entry, u8 flags) {
+    if (entry->status == FILE_NOT_FOUND || entry->status == FILE_READ_FAILED) {
+        print_error(entry->status == FILE_NOT_FOUND ? ERR_FILE_NOT_FOUND : ERR_FILE_READ_FAILED, entry->path);
+        check->unreadable++;
+        return ;
+    }
+    entry->match ? check->ok++ : check->failed++;
+    // -q only reports the failures
+    if (!entry->match || !IS_SET(flags, FLAG_Q)) {
+        output_write(entry->path, ft_strlen(entry->path));
+        output_write(entry->match ? ": OK\n" : ": FAILED\n", entry->match ? 5 : 9);
+    }
+}
+
+/**
+ * @brief Prints the entries that are done, in order, until at most keep entries are left
+ *
+ * @param check Verification state
+ * @param keep Number of entries that may stay in the window, waits for the others
+ * @param flags Output flags
+ */
+static void _check_flush(t_check *check, u64 keep, u8 flags) {
+    pthread_mutex_lock(&check->lock);
+    while (check->printed < check->pushed) {
+        t_check_entry *entry = &check->entries[check->printed % CHECK_WINDOW];
+        if (entry->status == FILE_PENDING) {
+            if (check->pushed - check->printed <= keep) {
+                break;
+            }
+            pthread_cond_wait(&check->done, &check->lock);
+            continue;
+        }
+        // the slot is only reused once printed is bumped
+        pthread_mutex_unlock(&check->lock);
+        _check_print(check, entry, flags);
+        pthread_mutex_lock(&check->lock);
+        check->printed++;
+    }
+    pthread_mutex_unlock(&check->lock);
+}
+
+/**
+ * @brief Parses a line of the manifest into the next free slot
+ *
+ * @param check Verification state
+ * @param line Line, without the newline
+ * @param length Length of the line
+ * @return true The line is an entry, false if it's improperly formatted
+ */
+static bool _check_parse(t_check *check, const char *line, i32 length) {
+    t_check_entry *entry = &check->entries[check->pushed % CHECK_WINDOW];
+    i32 hex = check->ctx.digest_size * 2;
+    i32 name = ft_strlen(check->ctx.alg_name);
+    const char *path, *digest;
+    i32 path_length;
+
+    // ALG (file) = hex, the file name may contain ") = " so the digest is taken from the end
+    if (length > name + 2 + 4 + hex && ft_memcmp(line, check->ctx.alg_name, name) == 0
+        && line[name] == ' ' && line[name + 1] == '(' && ft_memcmp(line + length - hex - 4, ") = ", 4) == 0) {
+        path = line + name + 2;
+        path_length = length - hex - 4 - name - 2;
+        digest = line + length - hex;
+    // hex file
+    } else if (length > hex + 1 && line[hex] == ' ') {
+        path = line + hex + 1;
+        path_length = length - hex - 1;
+        digest = line;
+    } else {
+        return (false);
+    }
+    if (!hex_decode(digest, entry->expected, check->ctx.digest_size)) {
+        return (false);
+    }
+    ft_memcpy(entry->path, path, path_length);
+    entry->path[path_length] = '\0';
+    entry->status = FILE_PENDING;
+    return (true);
+}
+
+/**
+ * @brief Handles a whole line of the manifest, pushes its entry to the workers
+ */
+static void _check_line(t_check *check, char *line, i32 length, bool overlong, bool threaded, u8 flags) {
+    if (length > 0 && line[length - 1] == '\r') {
+        length--;
+    }
+    if (length == 0 && !overlong) {
+        return ;
+    }
+    // make room for the entry first, its slot must have been printed
+    _check_flush(check, CHECK_WINDOW - 1, flags);
+    if (overlong || !_check_parse(check, line, length)) {
+        check->malformed++;
+        return ;
+    }
+    pthread_mutex_lock(&check->lock);
+    check->pushed++;
+    pthread_cond_signal(&check->work);
+    pthread_mutex_unlock(&check->lock);
+    if (!threaded) {
+        t_context ctx = check->ctx;
+        _check_next(check, &ctx, false);
+    }
+}
+
+/**
+ * @brief Prints the summary of the verification to stderr
+ */
+static void _check_summary(t_check *check) {
+    // after the results
+    output_flush();
+    ft_putstr_fd(2, "ft_ssl: ", 8);
+    ft_putnbr_fd(2, check->ok);
+    ft_putstr_fd(2, " OK, ", 5);
+    ft_putnbr_fd(2, check->failed);
+    ft_putstr_fd(2, " FAILED, ", 9);
+    ft_putnbr_fd(2, check->unreadable);
+    ft_putstr_fd(2, " unreadable, ", 13);
+    ft_putnbr_fd(2, check->malformed);
+    ft_putstr_fd(2, " improperly formatted\n", 22);
+}
+
+/**
+ * @brief Verifies the files listed in a manifest, prints OK / FAILED per entry and a summary
+ *
+ * @param ctx Hash context of the algorithm the manifest was made with
+ * @param path Path to the manifest, "-" for stdin
+ * @param flags Output flags, -q only prints the failures
+ * @param options Options (-j, -t)
+ * @return true Every entry matched, false otherwise (or if the manifest couldn't be read)
+ * 
+ *
+ * @note Improperly formatted lines are skipped and counted, they only fail if no line was valid
+ */
+bool check_manifest(t_context *ctx, char *path, u8 flags, const t_options *options) {
+    t_check check = {
+        .ctx = *ctx,
+        .tree_chunk = options->tree_chunk,
+        .alg = flags & (FLAG_ALG_MD5 | FLAG_ALG_SHA256),
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .work = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+    };
+    i32 jobs = options->jobs != 0 ? options->jobs : default_jobs();
+    pthread_t threads[MAX_JOBS];
+    i32 started = 0, fd = 0, length = 0;
+    char line[CHECK_LINE_MAX];
+    byte buffer[BUFFER_SIZE];
+    bool overlong = false;
+    i64 bytes_read;
+
+    if (ft_strcmp(path, "-") != 0 && (fd = open(path, O_RDONLY)) == -1) {
+        print_error(ERR_FILE_NOT_FOUND, path);
+        return (false);
+    }
+    check.entries = malloc(CHECK_WINDOW * sizeof(t_check_entry));
+    if (check.entries == NULL) {
+        print_error(ERR_MEM_ALLOC_FAILED, path);
+        close(fd);
+        return (false);
+    }
+    // without any thread, entries are hashed as they are parsed
+    for (; started < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, _check_worker, &check) != 0) {
+            break;
+        }
+    }
+    while ((bytes_read = read(fd, buffer, BUFFER_SIZE)) > 0) {
+        for (i64 start = 0, end; start < bytes_read; start = end + 1) {
+            for (end = start; end < bytes_read && buffer[end] != '\n'; end++);
+            if (length + end - start >= CHECK_LINE_MAX) {
+                overlong = true;
+            } else {
+                ft_memcpy(line + length, buffer + start, end - start);
+                length += end - start;
+            }
+            if (end < bytes_read) {
+                _check_line(&check, line, length, overlong, started > 0, flags);
+                length = 0;
+                overlong = false;
+            }
+        }
+    }
+    if (bytes_read == -1) {
+        print_error(ERR_FILE_READ_FAILED, path);
+    } else if (length > 0 || overlong) { // last line without a newline
+        _check_line(&check, line, length, overlong, started > 0, flags);
+    }
+    pthread_mutex_lock(&check.lock);
+    check.eof = true;
+    pthread_cond_broadcast(&check.work);
+    pthread_mutex_unlock(&check.lock);
+    _check_flush(&check, 0, flags);
+    for (i32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (fd != 0) {
+        close(fd);
+    }
+    free(check.entries);
+    _check_summary(&check);
+    return (bytes_read != -1 && check.failed == 0 && check.unreadable == 0 && (check.pushed > 0 || check.malformed == 0));
+}
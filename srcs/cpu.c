@@ -0,0 +1,140 @@
+#include "ft_ssl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+#endif
+
+static u32 _cpu_features = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Reads the XCR0 register, tells which register files the OS saves on context switches
+ *
+ * @note Must only be called if CPUID reports OSXSAVE
+ */
+static u64 _xgetbv(void) {
+    u32 eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((u64) edx << 32) | eax;
+}
+
+/**
+ * @brief Asks CPUID (and the OS) which instruction set extensions we're allowed to use
+ *
+ * @return u32 CPU_* bitmask
+ */
+static u32 _cpu_probe(void) {
+    u32 eax, ebx, ecx, edx, features = 0;
+    u64 xcr0 = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return (0);
+    }
+    if (edx & bit_SSE2) {
+        SET_FLAG(features, CPU_SSE2);
+    }
+    if (ecx & bit_SSSE3) {
+        SET_FLAG(features, CPU_SSSE3);
+    }
+    if (ecx & bit_SSE4_1) {
+        SET_FLAG(features, CPU_SSE41);
+    }
+    if (ecx & bit_OSXSAVE) {
+        xcr0 = _xgetbv();
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return (features);
+    }
+    // SHA-NI only uses xmm registers, no OS support needed
+    if (ebx & bit_SHA) {
+        SET_FLAG(features, CPU_SHA);
+    }
+    // ymm registers (SSE + AVX state) must be saved by the OS
+    if ((ebx & bit_AVX2) && (xcr0 & 0x06) == 0x06) {
+        SET_FLAG(features, CPU_AVX2);
+    }
+    // zmm registers (opmask + upper zmm + hi16 zmm) too
+    if ((ebx & bit_AVX512F) && (xcr0 & 0xe6) == 0xe6) {
+        SET_FLAG(features, CPU_AVX512F);
+    }
+    return (features);
+}
+#else
+static u32 _cpu_probe(void) {
+    return (0);
+}
+#endif
+
+/**
+ * @brief Probes the CPU once, before main() runs
+ *
+ * @note FT_SSL_CPU (hex mask, same bits as CPU_*) can be used to hide features, e.g. FT_SSL_CPU=0 forces the scalar code
+ */
+__attribute__((constructor))
+static void _cpu_init(void) {
+    _cpu_features = _cpu_probe();
+    char *mask = getenv("FT_SSL_CPU");
+    if (mask != NULL) {
+        _cpu_features &= (u32) strtoul(mask, NULL, 16);
+    }
+}
+
+/**
+ * @brief Returns the instruction set extensions available on this machine
+ *
+ * @return u32 CPU_* bitmask
+ */
+u32 cpu_features(void) {
+    return (_cpu_features);
+}
+
+/**
+ * @brief Picks the first kernel of a NULL-terminated table that this CPU can run
+ *
+ * @note Tables are sorted from fastest to slowest, the last entry must not require anything
+ *
+ * @param kernels Kernel table
+ * @return const t_kernel* Selected kernel
+ */
+const t_kernel *kernel_select(const t_kernel *kernels) {
+    u32 features = cpu_features();
+    for (i32 i = 0; kernels[i].name != NULL; i++) {
+        if (IS_SET(features, kernels[i].cpu_flags)) {
+            return (&kernels[i]);
+        }
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Same as kernel_select, for multi-buffer kernels
+ *
+ * @note Unlike single-buffer kernels, there may be no multi-buffer kernel for this CPU
+ *
+ * @param kernels Kernel table
+ * @return const t_mb_kernel* Selected kernel, NULL if none can run
+ */
+const t_mb_kernel *mb_kernel_select(const t_mb_kernel *kernels) {
+    u32 features = cpu_features();
+    for (i32 i = 0; kernels[i].name != NULL; i++) {
+        if (IS_SET(features, kernels[i].cpu_flags)) {
+            return (&kernels[i]);
+        }
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Reads the time-stamp counter, to report cycles per byte
+ *
+ * @note The TSC ticks at a constant rate, not at the current clock of the core
+ *
+ * @return u64 Reference cycles, 0 if there's no such counter
+ */
+u64 cpu_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (__builtin_ia32_rdtsc());
+#else
+    return (0);
+#endif
+}
@@ -4,8 +4,10 @@
 /**
  * @brief Prints an error message to stderr, with arguments
  *
+ * @note Flushes the buffered output first, so the error comes after the results printed before it
 */
 void print_error(const char *error_message, char *details) {
+    output_flush();
     ft_putstr_fd(2, "ft_ssl: ", 8);
     ft_putstr_fd(2, error_message, ft_strlen(error_message));
     if (details != NULL) {
@@ -27,6 +27,96 @@ void *ft_memcpy(void *dest, const void *src, u64 n) {
     return (dest);
 }
 
+void *ft_memset(void *dest, i32 c, u64 n) {
+    char *d = dest;
+    while (n-- > 0) {
+        *d++ = c;
+    }
+    return (dest);
+}
+
+i32 ft_memcmp(const void *s1, const void *s2, u64 n) {
+    const u8 *a = s1, *b = s2;
+    for (u64 i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return (a[i] - b[i]);
+        }
+    }
+    return (0);
+}
+
 i64 ft_putstr_fd(i32 fd, const void *s, i64 len) {
     return write(fd, (const char *)s, len);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Writes a number in decimal, without a NUL terminator
+ *
+ * @param dest Buffer of at least 20 bytes
+ * @param n Number
+ * @return i32 Number of bytes written
+ */
+i32 ft_nbrtostr(char *dest, u64 n) {
+    char digits[20];
+    i32 i = sizeof(digits);
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    ft_memcpy(dest, digits + i, sizeof(digits) - i);
+    return (sizeof(digits) - i);
+}
+
+i64 ft_putnbr_fd(i32 fd, u64 n) {
+    char digits[20];
+    return (ft_putstr_fd(fd, digits, ft_nbrtostr(digits, n)));
+}
+
+/**
+ * @brief Writes a non-negative number with a fixed number of decimals, right-aligned, without a NUL
+ * terminator
+ *
+ * @param dest Buffer of at least 64 bytes
+ * @param n Number, rounded to the last decimal
+ * @param decimals Number of decimals, at most 9
+ * @param width Minimum width, padded with spaces on the left
+ * @return i32 Number of bytes written
+ */
+i32 ft_floattostr(char *dest, f64 n, i32 decimals, i32 width) {
+    char out[64];
+    i32 i = sizeof(out);
+    u64 scale = 1;
+
+    for (i32 d = 0; d < decimals; d++) {
+        scale *= 10;
+    }
+    u64 fixed = (u64) (n * scale + 0.5);
+    for (i32 d = 0; d < decimals; d++, fixed /= 10) {
+        out[--i] = '0' + fixed % 10;
+    }
+    if (decimals > 0) {
+        out[--i] = '.';
+    }
+    do {
+        out[--i] = '0' + fixed % 10;
+        fixed /= 10;
+    } while (fixed > 0 && i > 0);
+    while (i > 0 && (i32) sizeof(out) - i < width) {
+        out[--i] = ' ';
+    }
+    ft_memcpy(dest, out + i, sizeof(out) - i);
+    return (sizeof(out) - i);
+}
+
+/**
+ * @brief Prints a non-negative number with a fixed number of decimals, right-aligned
+ *
+ * @param fd File descriptor
+ * @param n Number, rounded to the last decimal
+ * @param decimals Number of decimals, at most 9
+ * @param width Minimum width, padded with spaces on the left
+ */
+i64 ft_putfloat_fd(i32 fd, f64 n, i32 decimals, i32 width) {
+    char out[64];
+    return (ft_putstr_fd(fd, out, ft_floattostr(out, n, decimals, width)));
+}
@@ -1,99 +1,359 @@
 #include "ft_ssl.h"
 #include "unistd.h"
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static __thread sigjmp_buf *_map_jump = NULL; // Set while this thread reads mapped memory in map_guard
+static pthread_once_t _map_sigbus_once = PTHREAD_ONCE_INIT;
+
+typedef struct s_chomp_window {
+    t_context *ctxs;
+    i32 count;
+    const byte *data;
+    u64 size;
+} t_chomp_window;
 
 /**
- * @brief Copies BUFFER_SIZE bytes from the buffer to internal buffer
+ * @brief Feeds bytes to the hash, whole blocks are compressed straight from the caller's buffer
+ * 
+ * @note Only the bytes that don't fill a block are copied, they wait in ctx->buffer for the next call
  * 
  * @param ctx Hash context
  * @param buf A not-sentinel-terminated buffer
- * @param n Number of bytes to eat, if the number of bytes is greater than BUFFER_SIZE, automatically digests
+ * @param n Number of bytes to eat
  */
 void ctx_chomp(t_context *ctx, const byte *buf, u64 n) {
-    // if the new buffer size is greater than BUFFER_SIZE, digest the buffer
-    if (ctx->buffer_size + n > BUFFER_SIZE) {
-        u64 to_copy = BUFFER_SIZE - ctx->buffer_size;
+    u64 start;
+
+    STATS_COUNT(STATS_BYTES, n);
+    ctx->chomped_bytes += n;
+    // complete the block started by the previous call first
+    if (ctx->buffer_size > 0) {
+        u64 to_copy = BLOCK_SIZE - ctx->buffer_size;
+        if (to_copy > n) {
+            to_copy = n;
+        }
+        start = STATS_START();
         ft_memcpy(ctx->buffer + ctx->buffer_size, buf, to_copy);
-        ctx->chomped_bytes += to_copy;
+        STATS_STOP(STATS_COPY, start);
         ctx->buffer_size += to_copy;
-        ctx->digest_fn(ctx);
+        buf += to_copy;
+        n -= to_copy;
+        if (ctx->buffer_size < BLOCK_SIZE) {
+            return ;
+        }
+        start = STATS_START();
+        ctx->digest_fn(ctx->digest, ctx->buffer, 1);
+        STATS_STOP(STATS_DIGEST, start);
         ctx->buffer_size = 0;
-        ctx_chomp(ctx, buf + to_copy, n - to_copy);
-    } else {
-        ft_memcpy(ctx->buffer + ctx->buffer_size, buf, n);
-        ctx->chomped_bytes += n;
-        ctx->buffer_size += n;
     }
+    if (n >= BLOCK_SIZE) {
+        start = STATS_START();
+        ctx->digest_fn(ctx->digest, buf, n / BLOCK_SIZE);
+        STATS_STOP(STATS_DIGEST, start);
+        buf += n - n % BLOCK_SIZE;
+        n %= BLOCK_SIZE;
+    }
+    start = STATS_START();
+    ft_memcpy(ctx->buffer, buf, n);
+    STATS_STOP(STATS_COPY, start);
+    ctx->buffer_size = n;
 }
 
 /**
- * @brief Writes the digest to an output buffer, must be at least ctx->digest_size bytes long
+ * @brief Feeds the same bytes to several contexts
  * 
- * @note The buffer is not null-terminated
+ * @note The bytes are handed out MULTI_CHUNK at a time, every context hashes a chunk while it's still in cache
  * 
- * @param ctx Hash context
- * @param out Output buffer
+ * @param ctxs Hash contexts
+ * @param count Number of contexts
+ * @param buf A not-sentinel-terminated buffer
+ * @param n Number of bytes to eat
  */
-void ctx_hexdigest(t_context *ctx, unsigned char *out) {
-    for (u64 i = 0; i < ctx->digest_size; i++) {
-        out[i * 2] = "0123456789abcdef"[ctx->digest[i] >> 4];
-        out[i * 2 + 1] = "0123456789abcdef"[ctx->digest[i] & 0x0F];
+void ctx_chomp_all(t_context *ctxs, i32 count, const byte *buf, u64 n) {
+    u64 chunk;
+
+    if (count == 1) {
+        ctx_chomp(ctxs, buf, n);
+        return ;
+    }
+    for (; n > 0; buf += chunk, n -= chunk) {
+        chunk = n < MULTI_CHUNK ? n : MULTI_CHUNK;
+        for (i32 i = 0; i < count; i++) {
+            ctx_chomp(&ctxs[i], buf, chunk);
+        }
     }
-    out[ctx->digest_size * 2] = '\0';
 }
 
 /**
- * @brief Prints the digest to the standard output
+ * @brief Touching a page of a mapping past the end of a file that shrank raises SIGBUS: jumps back to
+ * map_guard, or crashes as usual when the fault comes from anywhere else
+ */
+static void _map_sigbus(int sig) {
+    struct sigaction action = {0};
+
+    if (_map_jump != NULL) {
+        siglongjmp(*_map_jump, 1);
+    }
+    // the faulting access runs again, and faults for good
+    action.sa_handler = SIG_DFL;
+    sigaction(sig, &action, NULL);
+}
+
+/**
+ * @brief Installs the SIGBUS handler, once for every thread
+ *
+ * @note SA_NODEFER: the jump leaves the handler without restoring the signal mask, SIGBUS must stay
+ * unblocked for the next file that shrinks
+ */
+static void _map_sigbus_install(void) {
+    struct sigaction action = {0};
+
+    action.sa_handler = _map_sigbus;
+    action.sa_flags = SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, NULL);
+}
+
+/**
+ * @brief Runs fn on the calling thread, a file that shrinks under the mappings it reads is a failure, not a crash
+ *
+ * @note fn is cut short on the faulting access, whatever it was writing is left half done
+ *
+ * @param fn Function reading mapped memory
+ * @param arg Argument of fn
+ * @return true fn returned, false if it touched a page past the end of a mapped file
+ */
+bool map_guard(void (*fn)(void *), void *arg) {
+    sigjmp_buf jump;
+
+    pthread_once(&_map_sigbus_once, _map_sigbus_install);
+    if (sigsetjmp(jump, 0) != 0) {
+        _map_jump = NULL;
+        return (false);
+    }
+    _map_jump = &jump;
+    fn(arg);
+    _map_jump = NULL;
+    return (true);
+}
+
+static void _chomp_window(void *arg) {
+    t_chomp_window *window = arg;
+
+    ctx_chomp_all(window->ctxs, window->count, window->data, window->size);
+}
+
+/**
+ * @brief Hashes a regular file in place from its current offset, mapping it one MMAP_WINDOW at a time
+ * 
+ * @note Stops at the first window that can't be mapped, the caller reads the rest with read().
+ * The file offset isn't moved. A file that shrinks while it's mapped is a read error, not a crash.
+ * 
+ * @param ctxs Hash contexts
+ * @param count Number of contexts
+ * @param fd File descriptor of the file
+ * @param regular Set to true if the file is a regular file
+ * @return i64 Number of bytes hashed, 0 if the file isn't a regular file, is too small to be worth it,
+ * or can't be mapped at all, -1 if it shrank while it was hashed
+ */
+static i64 _chomp_mapped(t_context *ctxs, i32 count, i32 fd, bool *regular) {
+    struct stat st;
+    u64 page = sysconf(_SC_PAGESIZE), offset, length, skip;
+    i64 start = lseek(fd, 0, SEEK_CUR);
+    t_chomp_window window = {.ctxs = ctxs, .count = count};
+    byte *map;
+
+    // stdin may be a regular file someone already started to read, or a resumed hash: start from there
+    *regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (!*regular || start < 0 || st.st_size - start < MMAP_MIN_SIZE) {
+        return (0);
+    }
+    for (offset = start; offset < (u64) st.st_size; offset += length) {
+        length = (u64) st.st_size - offset;
+        if (length > MMAP_WINDOW) {
+            length = MMAP_WINDOW;
+        }
+        // mappings start on a page boundary
+        skip = offset % page;
+        u64 map_start = STATS_START();
+        map = mmap(NULL, length + skip, PROT_READ, MAP_PRIVATE, fd, offset - skip);
+        STATS_COUNT(STATS_MAPS, 1);
+        if (map == MAP_FAILED) {
+            STATS_STOP(STATS_READ, map_start);
+            break;
+        }
+        // read-ahead the whole window, pages behind us can be dropped
+        madvise(map, length + skip, MADV_SEQUENTIAL);
+        madvise(map, length + skip, MADV_WILLNEED);
+        STATS_STOP(STATS_READ, map_start);
+        window.data = map + skip;
+        window.size = length;
+        // page faults are counted in the hashing phases
+        if (!map_guard(_chomp_window, &window)) {
+            munmap(map, length + skip);
+            return (-1);
+        }
+        munmap(map, length + skip);
+    }
+    return (offset - start);
+}
+
+/**
+ * @brief Feeds a whole file to one or several contexts, regular files are mapped, streams are read by a reader thread
+ * 
+ * @note The contexts are not finalized, the file is read once whatever the number of contexts
+ * 
+ * @param ctxs Hash contexts
+ * @param count Number of contexts
+ * @param fd File descriptor, read until the end
+ * @return true Success, false if reading failed
+ */
+bool ctx_chomp_fd(t_context *ctxs, i32 count, i32 fd) {
+    byte buffer[BUFFER_SIZE];
+    i64 bytes_read;
+    u32 depth;
+    u64 start;
+    bool ok, regular;
+
+    // regular files skip the copy, read() is only left with what couldn't be mapped (usually nothing)
+    i64 mapped = _chomp_mapped(ctxs, count, fd, &regular);
+    if (mapped == -1 || (mapped > 0 && lseek(fd, mapped, SEEK_CUR) == -1)) {
+        return (false);
+    }
+    start = STATS_START();
+    bytes_read = read(fd, buffer, BUFFER_SIZE);
+    STATS_STOP(STATS_READ, start);
+    STATS_COUNT(STATS_READS, 1);
+    if (bytes_read <= 0) {
+        return (bytes_read == 0);
+    }
+    ctx_chomp_all(ctxs, count, buffer, bytes_read);
+    // there's more than nothing to read from a stream, let a reader thread read ahead while we hash
+    depth = regular ? 0 : pipeline_depth();
+    if (depth > 1 && pipeline_chomp_fd(ctxs, count, fd, depth, &ok)) {
+        return (ok);
+    }
+    while (true) {
+        start = STATS_START();
+        bytes_read = read(fd, buffer, BUFFER_SIZE);
+        STATS_STOP(STATS_READ, start);
+        STATS_COUNT(STATS_READS, 1);
+        if (bytes_read <= 0) {
+            break;
+        }
+        ctx_chomp_all(ctxs, count, buffer, bytes_read);
+    }
+    return (bytes_read == 0);
+}
+
+/**
+ * @brief Feeds the next n bytes of a file to one or several contexts, leaving the rest to read
+ * 
+ * @note Read with read(), so the offset of the file is right after them for ctx_chomp_fd
+ * 
+ * @param ctxs Hash contexts
+ * @param count Number of contexts
+ * @param fd File descriptor
+ * @param n Number of bytes to feed
+ * @return i64 Number of bytes fed, less than n if the file ended first, -1 if reading failed
+ */
+i64 ctx_chomp_fd_prefix(t_context *ctxs, i32 count, i32 fd, u64 n) {
+    byte buffer[BUFFER_SIZE];
+    i64 bytes_read = 1;
+    u64 fed = 0, start;
+
+    while (fed < n && bytes_read > 0) {
+        start = STATS_START();
+        bytes_read = read(fd, buffer, n - fed < BUFFER_SIZE ? n - fed : BUFFER_SIZE);
+        STATS_STOP(STATS_READ, start);
+        STATS_COUNT(STATS_READS, 1);
+        if (bytes_read > 0) {
+            ctx_chomp_all(ctxs, count, buffer, bytes_read);
+            fed += bytes_read;
+        }
+    }
+    return (bytes_read == -1 ? -1 : (i64) fed);
+}
+
+/**
+ * @brief Writes the digest in hex to an output buffer, must be at least ctx->digest_size * 2 + 1 bytes long
+ * 
+ * @note The buffer is null-terminated
  * 
  * @param ctx Hash context
- * @param arg If not NULL, prints the argument, otherwise stdin
- * @param is_file If true, prints the filename, otherwise arg preceeded and succeeded by double quotes
-*/
-void ctx_print_digest(t_context *ctx, char *arg, bool is_file, u8 flags) {
-    unsigned char digest[ctx->digest_size * 2 + 1];
-    ctx_hexdigest(ctx, digest);
+ * @param out Output buffer
+ */
+void ctx_hexdigest(t_context *ctx, unsigned char *out) {
+    hex_encode(ctx->digest, (char *) out, ctx->digest_size);
+    out[ctx->digest_size * 2] = '\0';
+}
+
+static void _print_digest(t_context *ctx, char *arg, bool is_file, u8 flags) {
     if (IS_SET(flags, FLAG_Q)) {
-        ft_putstr_fd(1, digest, ctx->digest_size * 2);
-        ft_putstr_fd(1, "\n", 1);
+        output_hex(ctx->digest, ctx->digest_size);
+        output_write("\n", 1);
         return ;
     }
     if (IS_SET(flags, FLAG_R)) {
         if (is_file) {
-            ft_putstr_fd(1, digest, ctx->digest_size * 2);
-            ft_putstr_fd(1, " ", 1);
-            ft_putstr_fd(1, arg, ft_strlen(arg));
-            ft_putstr_fd(1, "\n", 1);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write(" ", 1);
+            output_write(arg, ft_strlen(arg));
+            output_write("\n", 1);
         } else if (arg != NULL) {
-            ft_putstr_fd(1, digest, ctx->digest_size * 2);
-            ft_putstr_fd(1, " \"", 2);
-            ft_putstr_fd(1, arg, ft_strlen(arg));
-            ft_putstr_fd(1, "\"\n", 2);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write(" \"", 2);
+            output_write(arg, ft_strlen(arg));
+            output_write("\"\n", 2);
         } else {
-            ft_putstr_fd(1, digest, ctx->digest_size * 2);
-            ft_putstr_fd(1, "\n", 1);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write("\n", 1);
         }
         return ;
     } else {
         if (is_file) {
-            ft_putstr_fd(1, ctx->alg_name, ft_strlen(ctx->alg_name));
-            ft_putstr_fd(1, " (", 2);
-            ft_putstr_fd(1, arg, ft_strlen(arg));
-            ft_putstr_fd(1, ") = ", 4);
-            ft_putstr_fd(1, digest, ctx->digest_size * 2);
-            ft_putstr_fd(1, "\n", 1);
+            output_write(ctx->alg_name, ft_strlen(ctx->alg_name));
+            output_write(" (", 2);
+            output_write(arg, ft_strlen(arg));
+            output_write(") = ", 4);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write("\n", 1);
         } else if (arg == NULL) {
+            // with several algorithms, every line says which one it is, e.g. MD5 (stdin) = ...
+            if (IS_SET(flags, FLAG_ALG_MULTI)) {
+                output_write(ctx->alg_name, ft_strlen(ctx->alg_name));
+                output_write(" ", 1);
+            }
             if (!IS_SET(flags, FLAG_P)) {
-                ft_putstr_fd(1, "(stdin) = ", 10);
+                output_write("(stdin) = ", 10);
             }
-            ft_putstr_fd(1, digest, ctx->digest_size * 2);
-            ft_putstr_fd(1, "\n", 1);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write("\n", 1);
         } else {
-            ft_putstr_fd(1, ctx->alg_name, ft_strlen(ctx->alg_name));
-            ft_putstr_fd(1, " (\"", 3);
-            ft_putstr_fd(1, arg, ft_strlen(arg));
-            ft_putstr_fd(1, "\"", 1);
-            ft_putstr_fd(1, ") = ", 4);
-            ft_putstr_fd(1, digest, ctx->digest_size * 2);
-            ft_putstr_fd(1, "\n", 1);
+            output_write(ctx->alg_name, ft_strlen(ctx->alg_name));
+            output_write(" (\"", 3);
+            output_write(arg, ft_strlen(arg));
+            output_write("\"", 1);
+            output_write(") = ", 4);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write("\n", 1);
         }
     }
 }
+
+/**
+ * @brief Prints the digest to the standard output
+ * 
+ * @param ctx Hash context
+ * @param arg If not NULL, prints the argument, otherwise stdin
+ * @param is_file If true, prints the filename, otherwise arg preceeded and succeeded by double quotes
+*/
+void ctx_print_digest(t_context *ctx, char *arg, bool is_file, u8 flags) {
+    u64 start = STATS_START();
+    _print_digest(ctx, arg, is_file, flags);
+    STATS_STOP(STATS_OUTPUT, start);
+}
@@ -0,0 +1,162 @@
+#include "ft_ssl.h"
+
+/**
+ * Hex encoding of digests and decoding of the digests of a manifest (-c). The SIMD kernels turn
+ * 16 bytes into hex at once with a table lookup in an SSSE3 shuffle (pshufb), and back with range
+ * checks and a multiply-add of the digit pairs. A whole MD5 / SHA-256 digest is one or two steps.
+ * A 32-byte AVX2 version is slower on a single digest, the cross-lane permutes cost more than the
+ * width saves.
+*/
+
+static const char _hex_digits[] = "0123456789abcdef";
+
+/**
+ * @brief Encodes bytes into lowercase hex, one byte at a time
+ *
+ * @param in Bytes to encode
+ * @param out Output buffer, size * 2 characters, not null-terminated
+ * @param size Number of bytes
+ */
+static void _hex_encode_scalar(const byte *in, char *out, u64 size) {
+    for (u64 i = 0; i < size; i++) {
+        out[i * 2] = _hex_digits[in[i] >> 4];
+        out[i * 2 + 1] = _hex_digits[in[i] & 0x0F];
+    }
+}
+
+/**
+ * @brief Decodes hex into bytes, one character at a time, lowercase or uppercase
+ *
+ * @param hex Hex string, at least size * 2 characters long
+ * @param out Output buffer, size bytes
+ * @param size Number of bytes to decode
+ * @return true Success, false if a character is not an hex digit
+ */
+static bool _hex_decode_scalar(const char *hex, byte *out, u64 size) {
+    for (u64 i = 0; i < size * 2; i++) {
+        u8 c = hex[i], value;
+        if (c >= '0' && c <= '9') {
+            value = c - '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            value = (c | 0x20) - 'a' + 10;
+        } else {
+            return (false);
+        }
+        out[i / 2] = i % 2 == 0 ? value << 4 : out[i / 2] | value;
+    }
+    return (true);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/**
+ * @brief Turns 16 characters into their nibble values, all lanes 0xFF are the valid ones
+ */
+__attribute__((target("ssse3")))
+static inline __m128i _hex_nibbles_ssse3(__m128i c, __m128i *valid) {
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    // unsigned x <= n  <=>  min(x, n) == x
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+
+    *valid = _mm_or_si128(is_digit, is_alpha);
+    return (_mm_or_si128(_mm_and_si128(is_digit, digit),
+        _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10)))));
+}
+
+__attribute__((target("ssse3")))
+static void _hex_encode_ssse3(const byte *in, char *out, u64 size) {
+    const __m128i digits = _mm_loadu_si128((const __m128i *) _hex_digits);
+    const __m128i low = _mm_set1_epi8(0x0F);
+
+    for (; size >= 16; size -= 16, in += 16, out += 32) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) in);
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), low));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, low));
+        _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    _hex_encode_scalar(in, out, size);
+}
+
+__attribute__((target("ssse3")))
+static bool _hex_decode_ssse3(const char *hex, byte *out, u64 size) {
+    // high nibble * 16 + low nibble, for every pair of characters
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i valid_a, valid_b;
+
+    for (; size >= 16; size -= 16, hex += 32, out += 16) {
+        __m128i a = _hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *) hex), &valid_a);
+        __m128i b = _hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *) (hex + 16)), &valid_b);
+        if (_mm_movemask_epi8(_mm_and_si128(valid_a, valid_b)) != 0xFFFF) {
+            return (false);
+        }
+        a = _mm_maddubs_epi16(a, weights);
+        b = _mm_maddubs_epi16(b, weights);
+        _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(a, b));
+    }
+    return (_hex_decode_scalar(hex, out, size));
+}
+#endif
+
+// Implementations, fastest first, picked the same way as the digest kernels
+static const t_hex_kernel _hex_kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"ssse3", CPU_SSSE3, _hex_encode_ssse3, _hex_decode_ssse3},
+#endif
+    {"scalar", 0, _hex_encode_scalar, _hex_decode_scalar},
+    {NULL, 0, NULL, NULL}
+};
+
+static const t_hex_kernel *_hex_kernel = NULL;
+
+/**
+ * @brief Returns the fastest hex implementation this CPU can run, chosen on first use
+ */
+static const t_hex_kernel *_hex_select(void) {
+    const t_hex_kernel *kernel = __atomic_load_n(&_hex_kernel, __ATOMIC_RELAXED);
+    u32 features;
+
+    if (kernel != NULL) {
+        return (kernel);
+    }
+    features = cpu_features();
+    for (kernel = _hex_kernels; !IS_SET(features, kernel->cpu_flags); kernel++)
+        ;
+    __atomic_store_n(&_hex_kernel, kernel, __ATOMIC_RELAXED);
+    return (kernel);
+}
+
+/**
+ * @brief Returns every hex implementation, fastest first
+ *
+ * @return const t_hex_kernel* NULL-terminated kernel table
+ */
+const t_hex_kernel *hex_kernels(void) {
+    return (_hex_kernels);
+}
+
+/**
+ * @brief Encodes bytes into lowercase hex
+ *
+ * @param in Bytes to encode
+ * @param out Output buffer, size * 2 characters, not null-terminated
+ * @param size Number of bytes
+ */
+void hex_encode(const byte *in, char *out, u64 size) {
+    _hex_select()->encode_fn(in, out, size);
+}
+
+/**
+ * @brief Decodes an hex string into bytes, lowercase or uppercase
+ *
+ * @param hex Hex string, at least size * 2 characters long
+ * @param out Output buffer, size bytes
+ * @param size Number of bytes to decode
+ * @return true Success, false if a character is not an hex digit
+ */
+bool hex_decode(const char *hex, byte *out, u64 size) {
+    return (_hex_select()->decode_fn(hex, out, size));
+}
@@ -0,0 +1,223 @@
+#include "ft_ssl.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * HMAC (RFC 2104) on top of the hash contexts: H((K ^ opad) || H((K ^ ipad) || message)).
+ * The key only changes the first block of both hashes, so both are compressed once, when the key
+ * is set, and their states (digest and chomped_bytes, the key block is already counted) are cloned
+ * for every message. A message costs the hash of its own bytes and one block for the outer hash,
+ * instead of two more blocks for the key.
+*/
+
+#define HMAC_LINES_BUFFER 65536 // bytes of stdin read at a time by --lines
+
+typedef struct s_hmac_alg {
+    char *name;                         // Name of the command
+    init_func init;
+    char *alg_name;                     // Printed in front of the digests
+} t_hmac_alg;
+
+static const t_hmac_alg _hmac_algs[] = {
+    {HMAC_MD5_COMMAND, md5_init, "HMAC-MD5"},
+    {HMAC_SHA256_COMMAND, sha256_init, "HMAC-SHA256"},
+    {NULL, NULL, NULL}
+};
+
+/**
+ * @brief Compresses the ipad and opad blocks of a key, once for every message signed with it
+ *
+ * @param hmac Keyed states to set up
+ * @param init Initialization function of the hash
+ * @param key Key, hashed first if it's longer than a block
+ * @param key_size Size of the key
+ */
+void hmac_init(t_hmac *hmac, init_func init, const byte *key, u64 key_size) {
+    byte block[BLOCK_SIZE] = {0};
+    t_context ctx;
+
+    if (key_size > BLOCK_SIZE) {
+        ctx = init(key_size);
+        ctx_chomp(&ctx, key, key_size);
+        ctx.final_fn(&ctx);
+        ft_memcpy(block, ctx.digest, ctx.digest_size);
+    } else {
+        ft_memcpy(block, key, key_size);
+    }
+    for (u32 i = 0; i < BLOCK_SIZE; i++) {
+        block[i] ^= 0x36;
+    }
+    hmac->inner = init(0);
+    ctx_chomp(&hmac->inner, block, BLOCK_SIZE);
+    for (u32 i = 0; i < BLOCK_SIZE; i++) {
+        block[i] ^= 0x36 ^ 0x5C;
+    }
+    hmac->outer = init(0);
+    ctx_chomp(&hmac->outer, block, BLOCK_SIZE);
+    ft_memset(block, 0, BLOCK_SIZE);
+}
+
+/**
+ * @brief Starts a message: the context takes the state of the inner hash right after the key
+ *
+ * @param hmac Keyed states
+ * @param ctx Context of the same algorithm
+ */
+void hmac_start(const t_hmac *hmac, t_context *ctx) {
+    ft_memcpy(ctx->digest, hmac->inner.digest, ctx->digest_size);
+    ctx->chomped_bytes = hmac->inner.chomped_bytes;
+    ctx->buffer_size = 0;
+}
+
+/**
+ * @brief Finishes the inner hash, then hashes it from the state of the outer hash right after the key
+ *
+ * @param hmac Keyed states
+ * @param ctx Context of the message, holds the HMAC afterwards
+ */
+void hmac_final(const t_hmac *hmac, t_context *ctx) {
+    byte inner[MAX_DIGEST_SIZE];
+
+    ctx->final_fn(ctx);
+    ft_memcpy(inner, ctx->digest, ctx->digest_size);
+    ft_memcpy(ctx->digest, hmac->outer.digest, ctx->digest_size);
+    ctx->chomped_bytes = hmac->outer.chomped_bytes;
+    ctx->buffer_size = 0;
+    ctx_chomp(ctx, inner, ctx->digest_size);
+    ctx->final_fn(ctx);
+}
+
+/**
+ * @brief Signs every line of stdin, prints one HMAC per line
+ *
+ * @note A line may span several reads, the newline isn't part of the message. A last line without
+ * a newline is signed too.
+ *
+ * @return true Success, false if reading failed
+ */
+static bool _hmac_lines(const t_hmac *hmac, t_context *ctx) {
+    static byte buffer[HMAC_LINES_BUFFER];
+    bool partial = false;
+    i64 bytes_read;
+
+    hmac_start(hmac, ctx);
+    while ((bytes_read = read(0, buffer, HMAC_LINES_BUFFER)) > 0) {
+        i64 start = 0;
+        for (i64 i = 0; i < bytes_read; i++) {
+            if (buffer[i] != '\n') {
+                continue;
+            }
+            ctx_chomp(ctx, buffer + start, i - start);
+            hmac_final(hmac, ctx);
+            output_hex(ctx->digest, ctx->digest_size);
+            output_write("\n", 1);
+            hmac_start(hmac, ctx);
+            start = i + 1;
+        }
+        ctx_chomp(ctx, buffer + start, bytes_read - start);
+        partial = bytes_read > start;
+    }
+    if (partial) {
+        hmac_final(hmac, ctx);
+        output_hex(ctx->digest, ctx->digest_size);
+        output_write("\n", 1);
+    }
+    return (bytes_read == 0);
+}
+
+/**
+ * @brief Signs a file, stdin if path is NULL, and prints its HMAC
+ *
+ * @return true Success, false if the file couldn't be opened or read
+ */
+static bool _hmac_file(const t_hmac *hmac, t_context *ctx, char *path, u8 flags) {
+    i32 fd = path != NULL ? open(path, O_RDONLY) : 0;
+
+    if (fd == -1) {
+        print_error(ERR_FILE_NOT_FOUND, path);
+        return (false);
+    }
+    hmac_start(hmac, ctx);
+    if (!ctx_chomp_fd(ctx, 1, fd)) {
+        print_error(ERR_FILE_READ_FAILED, path != NULL ? path : "(stdin)");
+        if (path != NULL) {
+            close(fd);
+        }
+        return (false);
+    }
+    if (path != NULL) {
+        close(fd);
+    }
+    hmac_final(hmac, ctx);
+    ctx_print_digest(ctx, path, path != NULL, flags);
+    return (true);
+}
+
+/**
+ * @brief The hmac-md5 / hmac-sha256 commands: -k KEY [-q] [-r] [--lines | -s STRING... | files...]
+ *
+ * @param argc Number of arguments
+ * @param argv All passed arguments, the flags come after argv[1]
+ * @return int Exit code
+ */
+int hmac_command(int argc, char **argv) {
+    const t_hmac_alg *alg = _hmac_algs;
+    char *key = NULL;
+    bool lines = false, ok = true, strings = false;
+    u8 flags = 0;
+    i32 i;
+    t_hmac hmac;
+    t_context ctx;
+
+    while (ft_strcmp(alg->name, argv[1]) != 0) {
+        alg++;
+    }
+    for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (ft_strcmp(argv[i], "-k") == 0 && key == NULL && i + 1 < argc) {
+            key = argv[++i];
+        } else if (ft_strcmp(argv[i], "-q") == 0 && !IS_SET(flags, FLAG_Q)) {
+            SET_FLAG(flags, FLAG_Q);
+        } else if (ft_strcmp(argv[i], "-r") == 0 && !IS_SET(flags, FLAG_R)) {
+            SET_FLAG(flags, FLAG_R);
+        } else if (ft_strcmp(argv[i], "--lines") == 0 && !lines) {
+            lines = true;
+        } else if (ft_strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            // strings are signed in the second pass
+            i++;
+            strings = true;
+        } else {
+            break;
+        }
+    }
+    if (key == NULL || (i < argc && argv[i][0] == '-' && argv[i][1] != '\0') || (lines && (strings || i < argc))) {
+        print_error(ERR_INVALID_FLAG, "usage: hmac-md5|hmac-sha256 -k KEY [-q] [-r] [--lines | -s STRING | files...]");
+        return (1);
+    }
+    hmac_init(&hmac, alg->init, (byte *) key, ft_strlen(key));
+    ctx = hmac.inner;
+    ctx.alg_name = alg->alg_name;
+    atexit(output_flush);
+    if (lines) {
+        if (!_hmac_lines(&hmac, &ctx)) {
+            print_error(ERR_FILE_READ_FAILED, "(stdin)");
+            return (1);
+        }
+        return (0);
+    }
+    for (i32 j = 2; j < i; j++) {
+        if (ft_strcmp(argv[j], "-s") == 0) {
+            hmac_start(&hmac, &ctx);
+            ctx_chomp(&ctx, (byte *) argv[j + 1], ft_strlen(argv[j + 1]));
+            hmac_final(&hmac, &ctx);
+            ctx_print_digest(&ctx, argv[j + 1], false, flags);
+        }
+        j += ft_strcmp(argv[j], "-k") == 0 || ft_strcmp(argv[j], "-s") == 0;
+    }
+    if (!strings && i == argc) {
+        ok = _hmac_file(&hmac, &ctx, NULL, flags);
+    }
+    for (; i < argc; i++) {
+        ok = _hmac_file(&hmac, &ctx, argv[i], flags) && ok;
+    }
+    return (!ok);
+}
@@ -0,0 +1,142 @@
+#include "ft_ssl.h"
+#include "libft_ssl.h"
+
+/**
+ * libft_ssl: the digest kernels of ft_ssl behind caller-allocated contexts (see libft_ssl.h).
+ * Only the functions of libft_ssl.h are exported, everything else is hidden / localized.
+*/
+
+static digest_func _md5_fn = NULL;
+static digest_func _sha256_fn = NULL;
+
+/**
+ * @brief Fastest digest function of a kernel table, selected once
+ *
+ * @note Threads racing on the first call all store the same pointer
+ */
+static digest_func _kernel(digest_func *cached, const t_kernel *kernels) {
+    digest_func fn = __atomic_load_n(cached, __ATOMIC_RELAXED);
+    if (fn == NULL) {
+        fn = kernel_select(kernels)->digest_fn;
+        __atomic_store_n(cached, fn, __ATOMIC_RELAXED);
+    }
+    return (fn);
+}
+
+/**
+ * @brief Same as ctx_chomp, on a state, a length and a block
+ */
+static void _update(digest_func fn, byte *state, uint64_t *length, byte *block, const byte *data, u64 n) {
+    u64 used = *length % BLOCK_SIZE;
+
+    *length += n;
+    if (used > 0) {
+        u64 to_copy = BLOCK_SIZE - used < n ? BLOCK_SIZE - used : n;
+        ft_memcpy(block + used, data, to_copy);
+        data += to_copy;
+        n -= to_copy;
+        if (used + to_copy < BLOCK_SIZE) {
+            return ;
+        }
+        fn(state, block, 1);
+    }
+    if (n >= BLOCK_SIZE) {
+        fn(state, data, n / BLOCK_SIZE);
+        data += n - n % BLOCK_SIZE;
+        n %= BLOCK_SIZE;
+    }
+    ft_memcpy(block, data, n);
+}
+
+/**
+ * @brief Pads the last bytes (less than a block) and compresses them
+ *
+ * @param fn Digest function
+ * @param state Intermediate hash value
+ * @param length Total number of bytes hashed
+ * @param tail The last length % 64 bytes
+ * @param big_endian True if the length is appended big-endian (SHA-256), little-endian otherwise (MD5)
+ */
+static void _final(digest_func fn, byte *state, u64 length, const byte *tail, bool big_endian) {
+    byte block[BLOCK_SIZE * 2];
+    u64 used = length % BLOCK_SIZE, bits = length * 8;
+    u64 size = used < 56 ? BLOCK_SIZE : BLOCK_SIZE * 2;
+
+    ft_memcpy(block, tail, used);
+    block[used] = 0x80;
+    ft_memset(block + used + 1, 0, size - used - 9);
+    for (i32 i = 0; i < 8; i++) {
+        block[size - 8 + i] = big_endian ? bits >> (56 - i * 8) : bits >> (i * 8);
+    }
+    fn(state, block, size / BLOCK_SIZE);
+}
+
+/**
+ * @brief The state words are kept little-endian, SHA-256 outputs them big-endian
+ */
+static void _output_be(const byte *state, u8 *out, u8 size) {
+    for (u8 i = 0; i < size; i += 4) {
+        out[i] = state[i + 3];
+        out[i + 1] = state[i + 2];
+        out[i + 2] = state[i + 1];
+        out[i + 3] = state[i];
+    }
+}
+
+FT_SSL_API void ft_md5_init(t_md5_ctx *ctx) {
+    ft_memcpy(ctx->state, md5_initial_digest, MD5_DIGEST_SIZE);
+    ctx->length = 0;
+}
+
+FT_SSL_API void ft_md5_update(t_md5_ctx *ctx, const void *data, size_t len) {
+    _update(_kernel(&_md5_fn, md5_kernels()), (byte *) ctx->state, &ctx->length, ctx->block, data, len);
+}
+
+FT_SSL_API void ft_md5_final(t_md5_ctx *ctx, uint8_t out[FT_MD5_DIGEST_SIZE]) {
+    _final(_kernel(&_md5_fn, md5_kernels()), (byte *) ctx->state, ctx->length, ctx->block, false);
+    ft_memcpy(out, ctx->state, MD5_DIGEST_SIZE);
+}
+
+/**
+ * @brief One-shot MD5, whole blocks are compressed straight from data, only the tail is copied
+ */
+FT_SSL_API void ft_md5(const void *data, size_t len, uint8_t out[FT_MD5_DIGEST_SIZE]) {
+    digest_func fn = _kernel(&_md5_fn, md5_kernels());
+    u32 state[MD5_DIGEST_SIZE / 4];
+
+    ft_memcpy(state, md5_initial_digest, MD5_DIGEST_SIZE);
+    if (len >= BLOCK_SIZE) {
+        fn((byte *) state, data, len / BLOCK_SIZE);
+    }
+    _final(fn, (byte *) state, len, (const byte *) data + len - len % BLOCK_SIZE, false);
+    ft_memcpy(out, state, MD5_DIGEST_SIZE);
+}
+
+FT_SSL_API void ft_sha256_init(t_sha256_ctx *ctx) {
+    ft_memcpy(ctx->state, sha256_initial_digest, SHA256_DIGEST_SIZE);
+    ctx->length = 0;
+}
+
+FT_SSL_API void ft_sha256_update(t_sha256_ctx *ctx, const void *data, size_t len) {
+    _update(_kernel(&_sha256_fn, sha256_kernels()), (byte *) ctx->state, &ctx->length, ctx->block, data, len);
+}
+
+FT_SSL_API void ft_sha256_final(t_sha256_ctx *ctx, uint8_t out[FT_SHA256_DIGEST_SIZE]) {
+    _final(_kernel(&_sha256_fn, sha256_kernels()), (byte *) ctx->state, ctx->length, ctx->block, true);
+    _output_be((byte *) ctx->state, out, SHA256_DIGEST_SIZE);
+}
+
+/**
+ * @brief One-shot SHA-256, whole blocks are compressed straight from data, only the tail is copied
+ */
+FT_SSL_API void ft_sha256(const void *data, size_t len, uint8_t out[FT_SHA256_DIGEST_SIZE]) {
+    digest_func fn = _kernel(&_sha256_fn, sha256_kernels());
+    u32 state[SHA256_DIGEST_SIZE / 4];
+
+    ft_memcpy(state, sha256_initial_digest, SHA256_DIGEST_SIZE);
+    if (len >= BLOCK_SIZE) {
+        fn((byte *) state, data, len / BLOCK_SIZE);
+    }
+    _final(fn, (byte *) state, len, (const byte *) data + len - len % BLOCK_SIZE, true);
+    _output_be((byte *) state, out, SHA256_DIGEST_SIZE);
+}
@@ -9,9 +9,56 @@ static const t_algorithm algorithms[] = {
 };
 
 static const char* valid_flags[] = {
-    "-p", "-q", "-r", "-s"
+    "-p", "-q", "-r", "-s", "-R", "-j N", "-t SIZE", "-c FILE", "--save-state FILE[:N]", "--resume FILE", "--stats", "--files-from FILE", "-0"
 };
 
+/**
+ * @brief Sets up a context per algorithm of a comma-separated list (-a of the multi command)
+ * 
+ * @param list Algorithms, e.g. "md5,sha256"
+ * @param ctxs Contexts to set up, at least MULTI_MAX_ALGORITHMS
+ * @return i32 Number of contexts, -1 if an algorithm is unknown or there are too many
+ */
+i32 parse_algorithms(char *list, t_context *ctxs) {
+    char name[16];
+    i32 count = 0, length, i;
+
+    while (true) {
+        for (length = 0; list[length] != ',' && list[length] != '\0'; length++);
+        if (length >= (i32) sizeof(name) || count == MULTI_MAX_ALGORITHMS) {
+            print_error(ERR_INVALID_ALGORITHM, list);
+            return (-1);
+        }
+        ft_memcpy(name, list, length);
+        name[length] = '\0';
+        for (i = 0; algorithms[i].name != NULL && ft_strcmp(name, algorithms[i].name) != 0; i++);
+        if (algorithms[i].name == NULL) {
+            print_error(ERR_INVALID_ALGORITHM, name);
+            return (-1);
+        }
+        ctxs[count++] = algorithms[i].init(0);
+        if (list[length] == '\0') {
+            return (count);
+        }
+        list += length + 1;
+    }
+}
+
+/**
+ * @brief Prints the digest of every context, one line per algorithm
+ * 
+ * @param ctxs Crypto contexts
+ * @param count Number of contexts
+ * @param arg Same as ctx_print_digest
+ * @param is_file Same as ctx_print_digest
+ * @param flags Output flags
+ */
+void print_digests(t_context *ctxs, i32 count, char *arg, bool is_file, u8 flags) {
+    for (i32 i = 0; i < count; i++) {
+        ctx_print_digest(&ctxs[i], arg, is_file, flags);
+    }
+}
+
 /**
  * @brief Passes the argument to the crypto context, when -s flag is used.
  * 
@@ -22,33 +69,38 @@ static const char* valid_flags[] = {
  */
 void parse_arg_input(t_context *ctx, char *arg) {
     ctx->known_size = ft_strlen(arg);
-    for (u64 i = 0; i < ctx->known_size; i += BUFFER_SIZE) {
-        i32 buffer_length = ctx->known_size - i;
-        if (buffer_length > BUFFER_SIZE) {
-            buffer_length = BUFFER_SIZE;
-        }
-        // Copy bytes from the buffer to the internal buffer
-        ctx_chomp(ctx, (byte *)arg + i, buffer_length);
-    }
+    ctx_chomp(ctx, (byte *)arg, ctx->known_size);
+    u64 start = STATS_START();
     ctx->final_fn(ctx);
+    STATS_STOP(STATS_FINAL, start);
 }
 
 /**
- * @brief Passes the passed file to the crypto context, when -s flag is not used, and a file is passed.
+ * @brief Passes the passed file to the crypto contexts, when -s flag is not used, and a file is passed.
  * 
- * @note If path is NULL, the function will read from stdin.
+ * @note If path is NULL, the function will read from stdin. The file is read once, whatever the number of contexts.
+ * With a single context and FT_SSL_CACHE, an unchanged file isn't even opened, its digest comes from the cache.
  * 
- * @param ctx Crypto context (contains the hash function)
+ * @param ctxs Crypto contexts (contain the hash functions)
+ * @param count Number of contexts
  * @param path Path to the file to hash
  * @param flags If `-p` is true and path is NULL, will echo stdin to stdout
  * 
  * @return true File was read successfully, false otherwise
 */
-bool parse_file_input(t_context *ctx, char *path, u8 flags) {
+bool parse_file_input(t_context *ctxs, i32 count, char *path, u8 flags) {
+    bool cached = path != NULL && count == 1 && cache_enabled();
+    t_cache_key key;
+    if (cached && cache_lookup(path, flags & (FLAG_ALG_MD5 | FLAG_ALG_SHA256), ctxs->digest, ctxs->digest_size, &key)) {
+        return (true);
+    }
+    u64 start = STATS_START(), final;
     int fd = 0; // default to stdin
     if (path != NULL) { // if path was specified, open the file for reading
         fd = open(path, O_RDONLY);
+        STATS_COUNT(STATS_OPENS, 1);
     }
+    STATS_STOP(STATS_READ, start);
     if (fd == -1) {
         print_error(ERR_FILE_NOT_FOUND, path);
         return (false);
@@ -61,7 +113,27 @@ bool parse_file_input(t_context *ctx, char *path, u8 flags) {
     // If -p is set, and path is NULL, echo stdin to stdout
     echo = IS_SET(flags, FLAG_P) && path == NULL;
     if (echo && !IS_SET(flags, FLAG_Q)) {
-        ft_putstr_fd(1, "(\"", 2);
+        output_write("(\"", 2);
+    }
+    if (!echo) {
+        if (!ctx_chomp_fd(ctxs, count, fd)) {
+            print_error(ERR_FILE_READ_FAILED, path);
+            close(fd);
+            return (false);
+        }
+        final = STATS_START();
+        for (i32 i = 0; i < count; i++) {
+            ctxs[i].final_fn(&ctxs[i]);
+        }
+        STATS_STOP(STATS_FINAL, final);
+        if (cached) {
+            cache_store(&key, fd, ctxs->digest, ctxs->digest_size);
+        }
+        close(fd);
+        if (stats_enabled && path != NULL) {
+            stats_file(path, ctxs->chomped_bytes, start);
+        }
+        return (true);
     }
     while (!eof) {
         bytes_read = read(fd, buffer, BUFFER_SIZE);
@@ -72,28 +144,286 @@ bool parse_file_input(t_context *ctx, char *path, u8 flags) {
         } else if (bytes_read == 0) {
             eof = true;
         } else {
-            ctx_chomp(ctx, buffer, bytes_read);
+            ctx_chomp_all(ctxs, count, buffer, bytes_read);
         }
         // if eof, or known_size is known and we have read all the bytes, or if we read less than BUFFER_SIZE, strip the last '\n' if any
         if (echo &&
-            (eof || (ctx->known_size != 0 && ctx->known_size == ctx->chomped_bytes + ctx->buffer_size) || bytes_read < BUFFER_SIZE)
+            (eof || (ctxs->known_size != 0 && ctxs->known_size == ctxs->chomped_bytes + ctxs->buffer_size) || bytes_read < BUFFER_SIZE)
         ) {
             if (buffer[bytes_read-1] == '\n' && IS_SET(flags, FLAG_P) && !IS_SET(flags, FLAG_Q)) {
                 bytes_read--;
             }
         }
         if (echo) {
-            ft_putstr_fd(1, buffer, (i64) bytes_read);
+            output_write(buffer, (i64) bytes_read);
         }
     }
-    ctx->final_fn(ctx);
+    final = STATS_START();
+    for (i32 i = 0; i < count; i++) {
+        ctxs[i].final_fn(&ctxs[i]);
+    }
+    STATS_STOP(STATS_FINAL, final);
     if (echo && !IS_SET(flags, FLAG_Q)) {
-        ft_putstr_fd(1, "\") = ", 5);
+        output_write("\") = ", 5);
     }
     close(fd);
     return (true);
 }
 
+/**
+ * @brief Hashes stdin with several algorithms (multi -p), keeping what it read to echo it on every line
+ * 
+ * @note The echo can't be streamed, it's repeated after each algorithm name. The last '\n' is hashed, not echoed.
+ * 
+ * @param ctxs Crypto contexts (contain the hash functions), finalized
+ * @param count Number of contexts
+ * @return char* What was read, null-terminated, NULL on error (already printed)
+ */
+char *parse_echo_input(t_context *ctxs, i32 count) {
+    char *text = NULL;
+    u64 size = 0, capacity = 0;
+    i64 bytes_read;
+
+    do {
+        if (size + BUFFER_SIZE + 1 > capacity) {
+            capacity = capacity > 0 ? capacity * 2 : BUFFER_SIZE * 2;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                print_error(ERR_MEM_ALLOC_FAILED, "-p");
+                free(text);
+                return (NULL);
+            }
+            text = grown;
+        }
+        bytes_read = read(0, text + size, BUFFER_SIZE);
+        size += bytes_read > 0 ? bytes_read : 0;
+    } while (bytes_read > 0);
+    if (bytes_read == -1) {
+        print_error(ERR_FILE_READ_FAILED, "(stdin)");
+        free(text);
+        return (NULL);
+    }
+    ctx_chomp_all(ctxs, count, (byte *) text, size);
+    for (i32 i = 0; i < count; i++) {
+        ctxs[i].final_fn(&ctxs[i]);
+    }
+    text[size > 0 && text[size - 1] == '\n' ? size - 1 : size] = '\0';
+    return (text);
+}
+
+/**
+ * @brief Tree hashes a file (-t), its chunks are hashed on -j threads, one per CPU by default
+ * 
+ * @param ctx Crypto context (contains the hash functions)
+ * @param path Path to the file to hash, NULL for stdin
+ * @param options Options (-t, -j)
+ * @return true File was read successfully, false otherwise
+ */
+bool parse_tree_input(t_context *ctx, char *path, const t_options *options) {
+    i32 jobs = options->jobs != 0 ? options->jobs : default_jobs();
+    int fd = 0; // default to stdin
+    if (path != NULL) {
+        fd = open(path, O_RDONLY);
+    }
+    if (fd == -1) {
+        print_error(ERR_FILE_NOT_FOUND, path);
+        return (false);
+    }
+    bool ok = tree_hash_fd(ctx, fd, options->tree_chunk, jobs);
+    if (!ok) {
+        print_error(ERR_FILE_READ_FAILED, path);
+    }
+    if (path != NULL) {
+        close(fd);
+    }
+    return (ok);
+}
+
+/**
+ * @brief Hashes a file starting from a saved state (--resume), and/or saves the state before finalizing (--save-state)
+ * 
+ * @note A resumed regular file is read from the offset of the state, a stream is expected to only have the bytes after it.
+ * With a byte count (--save-state FILE:N), the state is saved once N bytes were hashed, counting the resumed ones,
+ * and the rest of the input is hashed to print the digest of the whole input.
+ * 
+ * @param ctx Crypto context (contains the hash functions)
+ * @param path Path to the file to hash, NULL for stdin
+ * @param options Options (--save-state, --resume)
+ * @return true Success, false otherwise (the error has been printed)
+ */
+bool parse_state_input(t_context *ctx, char *path, const t_options *options) {
+    int fd = 0; // default to stdin
+    if (options->resume != NULL && !state_load(ctx, options->resume)) {
+        print_error(ERR_INVALID_STATE, options->resume);
+        return (false);
+    }
+    if (path != NULL && (fd = open(path, O_RDONLY)) == -1) {
+        print_error(ERR_FILE_NOT_FOUND, path);
+        return (false);
+    }
+    // pipes can't seek, they are left as they are
+    i64 end = options->resume != NULL ? lseek(fd, 0, SEEK_END) : -1;
+    if (end != -1 && ((u64) end < ctx->chomped_bytes || lseek(fd, ctx->chomped_bytes, SEEK_SET) == -1)) {
+        print_error(ERR_STATE_PAST_END, path != NULL ? path : "(stdin)");
+        if (path != NULL) {
+            close(fd);
+        }
+        return (false);
+    }
+    i64 fed = 0;
+    u64 left = options->save_at - ctx->chomped_bytes;
+    if (options->save_at != 0 && (options->save_at < ctx->chomped_bytes
+        || (fed = ctx_chomp_fd_prefix(ctx, 1, fd, left)) != (i64) left)) {
+        print_error(fed == -1 ? ERR_FILE_READ_FAILED : ERR_STATE_OFFSET, path != NULL ? path : "(stdin)");
+        if (path != NULL) {
+            close(fd);
+        }
+        return (false);
+    }
+    // with a byte count the state is saved here, otherwise once the whole input is hashed
+    bool saved = options->save_at == 0 || state_save(ctx, options->save_state);
+    bool ok = ctx_chomp_fd(ctx, 1, fd);
+    if (path != NULL) {
+        close(fd);
+    }
+    if (!ok) {
+        print_error(ERR_FILE_READ_FAILED, path);
+        return (false);
+    }
+    if (options->save_state != NULL && options->save_at == 0) {
+        saved = state_save(ctx, options->save_state);
+    }
+    if (!saved) {
+        print_error(ERR_STATE_WRITE_FAILED, options->save_state);
+        return (false);
+    }
+    u64 start = STATS_START();
+    ctx->final_fn(ctx);
+    STATS_STOP(STATS_FINAL, start);
+    return (true);
+}
+
+/**
+ * @brief Hashes every file of a list, printing their digest in order
+ * 
+ * @note Files are spread over threads with -j, otherwise several files are hashed side by side
+ * when the context has a multi-buffer kernel or io_uring is available.
+ * With several contexts (multi command), each file is read once and fed to all of them.
+ * With -t, files are tree hashed one after the other, the threads working on the chunks of a file.
+ * With -R, directories are walked and the files under them hashed on -j threads (one per CPU by default).
+ * 
+ * @param ctxs Crypto contexts (contain the hash functions)
+ * @param nctx Number of contexts
+ * @param paths Paths of the files to hash
+ * @param count Number of files
+ * @param flags Output flags
+ * @param options Options (-j, -t, -R)
+ */
+void hash_files(t_context *ctxs, i32 nctx, char **paths, i32 count, u8 flags, const t_options *options) {
+    if (options->recursive && count > 0 && walk_hash_paths(ctxs, paths, count, flags, options->jobs)) {
+        return ;
+    }
+    if (options->tree_chunk != 0) {
+        for (i32 i = 0; i < count; i++) {
+            if (parse_tree_input(ctxs, paths[i], options)) {
+                ctx_print_digest(ctxs, paths[i], true, flags);
+            }
+        }
+        return ;
+    }
+    if (nctx == 1 && count > 1 && options->jobs > 1 && pool_hash_files(ctxs, paths, count, flags, options->jobs)) {
+        return ;
+    }
+    // the multi-buffer path reads every file, the cache is only looked up file by file
+    if (nctx == 1 && count > 1 && !cache_enabled() && mb_hash_files(ctxs, paths, count, flags)) {
+        return ;
+    }
+    for (i32 i = 0; i < count; i++) {
+        for (i32 c = 0; c < nctx; c++) {
+            ctxs[c].reset_fn(&ctxs[c]);
+        }
+        if (parse_file_input(ctxs, nctx, paths[i], flags)) {
+            print_digests(ctxs, nctx, paths[i], true, flags);
+        }
+    }
+}
+
+/**
+ * @brief Hashes the files listed in a file or on stdin (--files-from), while the list is being read
+ * 
+ * @note Paths go to hash_files a read at a time, as many as the buffer holds. Memory doesn't grow
+ * with the list. A list still being written by another program is hashed as it comes. Empty paths
+ * are skipped, the last one doesn't need a delimiter.
+ * 
+ * @param ctxs Crypto contexts
+ * @param nctx Number of contexts
+ * @param flags Output flags
+ * @param options Options, with the list and its delimiter (-0)
+ * @return true Success, false if the list couldn't be read or a path was longer than FILES_FROM_BUFFER
+ */
+bool hash_files_from(t_context *ctxs, i32 nctx, u8 flags, const t_options *options) {
+    static char buffer[FILES_FROM_BUFFER];
+    static char *paths[FILES_FROM_BUFFER / 2];
+    char delimiter = options->null_delimited ? '\0' : '\n';
+    u64 size = 0, start, scanned;
+    i64 bytes_read = 1;
+    i32 count, fd = 0;
+    bool ok = true, skipping = false;
+
+    if (ft_strcmp(options->files_from, "-") != 0 && (fd = open(options->files_from, O_RDONLY)) == -1) {
+        print_error(ERR_FILE_NOT_FOUND, options->files_from);
+        return (false);
+    }
+    while (bytes_read > 0) {
+        bytes_read = read(fd, buffer + size, sizeof(buffer) - size);
+        if (bytes_read == -1) {
+            print_error(ERR_FILE_READ_FAILED, options->files_from);
+            ok = false;
+            break;
+        }
+        scanned = size;
+        size += bytes_read;
+        // what's left once the list ends is the last path, there's always room for its delimiter
+        if (bytes_read == 0 && size > 0) {
+            buffer[size++] = delimiter;
+        }
+        count = 0;
+        start = 0;
+        for (u64 i = scanned; i < size; i++) {
+            if (buffer[i] != delimiter) {
+                continue;
+            }
+            buffer[i] = '\0';
+            if (i > start && !skipping) {
+                paths[count++] = buffer + start;
+            }
+            skipping = false;
+            start = i + 1;
+        }
+        hash_files(ctxs, nctx, paths, count, flags, options);
+        // the results are out before waiting for more of the list
+        if (count > 0) {
+            output_flush();
+        }
+        // a path that fills the buffer is dropped up to its delimiter, the others move to the front
+        if (start == 0 && size == sizeof(buffer)) {
+            if (!skipping) {
+                print_error(ERR_PATH_TOO_LONG, options->files_from);
+            }
+            skipping = true;
+            ok = false;
+            size = 0;
+        } else {
+            ft_memcpy(buffer, buffer + start, size - start);
+            size -= start;
+        }
+    }
+    if (fd != 0) {
+        close(fd);
+    }
+    return (ok);
+}
+
 char *get_next_arg(i32 argc, char **argv, i32 offset) {
     return (offset < argc ? argv[offset] : NULL);
 }
@@ -105,21 +435,38 @@ int main(int argc, char **argv) {
         ft_putstr_fd(2, " command [flags] [file/string]\n", 31);
         return (1);
     }
+    if (ft_strcmp(argv[1], CACHE_COMMAND) == 0) {
+        return (cache_command(argc, argv));
+    } else if (ft_strcmp(argv[1], SPEED_COMMAND) == 0) {
+        return (speed_command(argc, argv));
+    } else if (ft_strcmp(argv[1], SERVE_COMMAND) == 0) {
+        return (serve_command(argc, argv));
+    } else if (ft_strcmp(argv[1], HMAC_MD5_COMMAND) == 0 || ft_strcmp(argv[1], HMAC_SHA256_COMMAND) == 0) {
+        return (hmac_command(argc, argv));
+    } else if (ft_strcmp(argv[1], PBKDF2_COMMAND) == 0) {
+        return (pbkdf2_command(argc, argv));
+    }
     u8 flags = 0;
-    t_context crypto_ctx;
-    crypto_ctx.alg_name = NULL;
+    t_options options = {0};
+    t_context crypto_ctxs[MULTI_MAX_ALGORITHMS];
+    i32 nctx = 0;
 
     // Find the algorithm that corresponds to the first argument
     for (i32 i = 0; algorithms[i].name != NULL; i++) {
         if (ft_strcmp(argv[1], algorithms[i].name) == 0) {
             flags |= algorithms[i].flag;
-            crypto_ctx = algorithms[i].init(0);
+            crypto_ctxs[0] = algorithms[i].init(0);
+            nctx = 1;
             break;
         }
     }
+    // the multi command gets its algorithms from -a
+    if (ft_strcmp(argv[1], MULTI_COMMAND) == 0) {
+        SET_FLAG(flags, FLAG_ALG_MULTI);
+    }
 
     // if no algorithm was found, print an error and return
-    if (crypto_ctx.alg_name == NULL) {
+    if (nctx == 0 && !IS_SET(flags, FLAG_ALG_MULTI)) {
         ft_putstr_fd(2, "ft_ssl: Error: '", 16);
         ft_putstr_fd(2, argv[1], ft_strlen(argv[1]));
         ft_putstr_fd(2, "' is an invalid command.\n\nCommands:\n", 36);
@@ -127,8 +474,16 @@ int main(int argc, char **argv) {
             ft_putstr_fd(2, algorithms[i].name, ft_strlen(algorithms[i].name));
             ft_putstr_fd(2, "\n", 1);
         }
+        ft_putstr_fd(2, MULTI_COMMAND " -a alg1,alg2,...\n", ft_strlen(MULTI_COMMAND) + 18);
+        ft_putstr_fd(2, CACHE_COMMAND " stats|clear\n", ft_strlen(CACHE_COMMAND) + 13);
+        ft_putstr_fd(2, SPEED_COMMAND " [md5|sha256] [-j N]\n", ft_strlen(SPEED_COMMAND) + 21);
+        ft_putstr_fd(2, SERVE_COMMAND " --socket PATH\n", ft_strlen(SERVE_COMMAND) + 15);
+        ft_putstr_fd(2, HMAC_MD5_COMMAND "|" HMAC_SHA256_COMMAND " -k KEY [--lines]\n",
+            ft_strlen(HMAC_MD5_COMMAND "|" HMAC_SHA256_COMMAND) + 18);
+        ft_putstr_fd(2, PBKDF2_COMMAND " -s SALT -i ITERATIONS [-l LENGTH] [-j N] [-p PASSWORD]\n",
+            ft_strlen(PBKDF2_COMMAND) + 56);
         ft_putstr_fd(2, "\nFlags:\n", 8);
-        for (i32 i = 0; i < 4; i++) {
+        for (i32 i = 0; i < (i32) (sizeof(valid_flags) / sizeof(*valid_flags)); i++) {
             ft_putstr_fd(2, valid_flags[i], ft_strlen(valid_flags[i]));
             ft_putstr_fd(2, " ", 1);
         }
@@ -137,14 +492,87 @@ int main(int argc, char **argv) {
     }
 
     // Otherwise, we can parse the arguments
-    i32 parameters = parse_parameters(argc, argv, &flags);
+    i32 parameters = parse_parameters(argc, argv, &flags, &options);
     if (parameters == -1) {
         return (1);
     }
+    // results are buffered, whatever is left is written when main returns
+    atexit(output_flush);
+    // before any thread is started
+    if (options.stats) {
+        stats_init();
+    }
+    if (IS_SET(flags, FLAG_ALG_MULTI)) {
+        if (options.algorithms == NULL) {
+            print_error(ERR_INVALID_FLAG, "no algorithms specified, use -a");
+            return (1);
+        }
+        nctx = parse_algorithms(options.algorithms, crypto_ctxs);
+        if (nctx == -1) {
+            return (1);
+        }
+    }
+    if (options.tree_chunk != 0) {
+        // the root is only defined for one algorithm over a plain input
+        if (IS_SET(flags, FLAG_ALG_MULTI) || IS_SET(flags, FLAG_P)) {
+            print_error(ERR_INVALID_FLAG, IS_SET(flags, FLAG_P) ? "-t can't be used with -p" : "-t can't be used with multi");
+            return (1);
+        }
+        tree_alg_name(crypto_ctxs, options.tree_chunk);
+    }
+    if (options.null_delimited && options.files_from == NULL) {
+        print_error(ERR_INVALID_FLAG, "-0 only applies to --files-from");
+        return (1);
+    } else if (options.files_from != NULL && ft_strcmp(options.files_from, "-") == 0 && IS_SET(flags, FLAG_P)) {
+        print_error(ERR_INVALID_FLAG, "--files-from - can't be used with -p");
+        return (1);
+    }
+    if (options.recursive && (IS_SET(flags, FLAG_ALG_MULTI) || options.tree_chunk != 0 || options.manifest != NULL
+        || options.save_state != NULL || options.resume != NULL)) {
+        print_error(ERR_INVALID_FLAG, options.tree_chunk != 0 ? "-R can't be used with -t"
+            : options.manifest != NULL ? "-R can't be used with -c"
+            : options.save_state != NULL || options.resume != NULL ? "-R can't be used with --save-state or --resume"
+            : "-R can't be used with multi");
+        return (1);
+    }
+    // a saved state only makes sense for one algorithm over a single input
+    if (options.save_state != NULL || options.resume != NULL) {
+        if (IS_SET(flags, FLAG_ALG_MULTI) || IS_SET(flags, FLAG_P) || IS_SET(flags, FLAG_S) || options.tree_chunk != 0
+            || options.manifest != NULL || options.files_from != NULL || argc > 3 + parameters) {
+            print_error(ERR_INVALID_FLAG, "--save-state and --resume take a single file or stdin");
+            return (1);
+        }
+        char *path = get_next_arg(argc, argv, 2 + parameters);
+        if (!parse_state_input(crypto_ctxs, path, &options)) {
+            return (1);
+        }
+        ctx_print_digest(crypto_ctxs, path, path != NULL, IS_SET(flags, FLAG_Q) ? flags & ~FLAG_R : flags);
+        return (0);
+    }
+    // only opened once, the threads hashing files share the mapping
+    if (options.tree_chunk == 0 && !IS_SET(flags, FLAG_ALG_MULTI)) {
+        cache_init();
+    }
+    // -c verifies the manifest, and only that
+    if (options.manifest != NULL) {
+        if (IS_SET(flags, FLAG_ALG_MULTI) || IS_SET(flags, FLAG_P) || IS_SET(flags, FLAG_S) || options.files_from != NULL
+            || argc > 2 + parameters) {
+            print_error(ERR_INVALID_FLAG, "-c takes no other input");
+            return (1);
+        }
+        return (check_manifest(crypto_ctxs, options.manifest, flags, &options) ? 0 : 1);
+    }
     // if -p was passed, read from stdin, or if only parameters were passed, read from stdin
-    if (IS_SET(flags, FLAG_P)) {
-        parse_file_input(&crypto_ctx, NULL, flags);
-        ctx_print_digest(&crypto_ctx, NULL, false, flags);
+    if (IS_SET(flags, FLAG_P) && nctx > 1 && !IS_SET(flags, FLAG_Q)) {
+        // printed like -s, e.g. SHA256 ("hi") = ...
+        char *text = parse_echo_input(crypto_ctxs, nctx);
+        if (text != NULL) {
+            print_digests(crypto_ctxs, nctx, text, false, flags);
+        }
+        free(text);
+    } else if (IS_SET(flags, FLAG_P)) {
+        parse_file_input(crypto_ctxs, nctx, NULL, flags);
+        print_digests(crypto_ctxs, nctx, NULL, false, flags);
     }
 
     // -q cancels -r
@@ -152,31 +580,39 @@ int main(int argc, char **argv) {
         UNSET_FLAG(flags, FLAG_R);
     }
 
-    // Consider the rest of the arguments as files, except -s and the following arguments
-    for (i32 i = 2 + parameters; i < argc; i++) {
-        crypto_ctx.reset_fn(&crypto_ctx);
+    // Consider the rest of the arguments as files, except -s and the following argument
+    i32 i = 2 + parameters;
+    if (i < argc && IS_SET(flags, FLAG_S)) {
         char *next = get_next_arg(argc, argv, i+1);
-        // if the first argument we parse is -s
-        if (i == 2 + parameters && IS_SET(flags, FLAG_S)) {
-            if (next == NULL) { // no argument after -s, consider it as an error
-                print_error(ERR_INVALID_FLAG, "no string specified after -s");
-                return (1);
+        if (next == NULL) { // no argument after -s, consider it as an error
+            print_error(ERR_INVALID_FLAG, "no string specified after -s");
+            return (1);
+        }
+        for (i32 c = 0; c < nctx; c++) {
+            crypto_ctxs[c].reset_fn(&crypto_ctxs[c]);
+            if (options.tree_chunk != 0) {
+                tree_hash_buffer(&crypto_ctxs[c], (byte *)next, ft_strlen(next), options.tree_chunk, 1);
             } else {
-                parse_arg_input(&crypto_ctx, next); // pass the string to the crypto context
-                i++;
+                parse_arg_input(&crypto_ctxs[c], next); // pass the string to the crypto context
             }
-        } else if (!parse_file_input(&crypto_ctx, argv[i], flags)) { // whatever the next argument is, it will be interpreted as a string
-            continue; // skip to the next input, the error message has already been printed
         }
-        // Print the digest & unset -s
-        ctx_print_digest(&crypto_ctx, IS_SET(flags, FLAG_S) ? next : argv[i], !IS_SET(flags, FLAG_S), flags);
+        print_digests(crypto_ctxs, nctx, next, false, flags);
         UNSET_FLAG(flags, FLAG_S);
+        i += 2;
+    }
+    hash_files(crypto_ctxs, nctx, argv + i, argc - i, flags, &options);
+    if (options.files_from != NULL) {
+        return (hash_files_from(crypto_ctxs, nctx, flags, &options) ? 0 : 1);
     }
 
     // If no arguments were passed, read from stdin
-    if (argc == 2 + parameters && !IS_SET(flags, FLAG_P)) {
-        parse_file_input(&crypto_ctx, NULL, flags);
-        ctx_print_digest(&crypto_ctx, NULL, false, flags);
+    if (argc == 2 + parameters && !IS_SET(flags, FLAG_P) && options.tree_chunk != 0) {
+        if (parse_tree_input(crypto_ctxs, NULL, &options)) {
+            ctx_print_digest(crypto_ctxs, NULL, false, flags);
+        }
+    } else if (argc == 2 + parameters && !IS_SET(flags, FLAG_P)) {
+        parse_file_input(crypto_ctxs, nctx, NULL, flags);
+        print_digests(crypto_ctxs, nctx, NULL, false, flags);
     }
     return 0;
 }
@@ -1,8 +1,9 @@
 #include "ft_ssl.h"
+#include "md5_steps.h"
 
 // https://en.wikipedia.org/wiki/MD5
 
-static const u32 _md5_initial_digest[MD5_DIGEST_SIZE / 4] = {
+const u32 md5_initial_digest[MD5_DIGEST_SIZE / 4] = {
     0x67452301,
     0xefcdab89,
     0x98badcfe,
@@ -10,7 +11,7 @@ static const u32 _md5_initial_digest[MD5_DIGEST_SIZE / 4] = {
 };
 
 // s specifies the per-round shift amounts
-static const u32 s[] = {
+const u32 md5_s[64] = {
     7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
     5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
     4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
@@ -18,7 +19,7 @@ static const u32 s[] = {
 };
 
 // Pre-computed radians (to avoid using costly trigonometric functions)
-static const u32 k[] = {
+const u32 md5_k[64] = {
     0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
     0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
     0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
@@ -38,27 +39,29 @@ static const u32 k[] = {
 };
 
 /**
- * @brief Eats BUFFER_SIZE bytes from the buffer and updates the hash context
+ * @brief Compresses whole 64-byte blocks into the intermediate hash value
  * 
- * @param ctx Hash context
- * @param buf A sentinel-terminated buffer
- * @param n Number of bytes to eat (if > BUFFER_SIZE, the rest is dropped)
+ * @note Compact version, kept as a reference for md5_digest_unrolled
+ * 
+ * @param digest Intermediate hash value (4 little endian 32-bit words)
+ * @param blocks Message blocks, read in place
+ * @param nblocks Number of 64-byte blocks to compress
  */
-void md5_digest(t_context *ctx) {
+void md5_digest(byte *digest, const byte *blocks, u64 nblocks) {
     // process 512-bit chunks (512 / 8 = 64)
     u32 dwords[16];
     u32 h0, h1, h2, h3, f, g, pivot, a, b, c, d;
 
     // digest is a unsigned char array, h0..3 are 32-bit integers
     // for each var, fetch 4 bytes from the digest and convert them to a 32-bit integer
-    h0 = to_u32(ctx->digest);
-    h1 = to_u32(ctx->digest + 4);
-    h2 = to_u32(ctx->digest + 8);
-    h3 = to_u32(ctx->digest + 12);
-    for (u32 offset = 0; offset < ctx->buffer_size; offset += 64) {
+    h0 = to_u32(digest);
+    h1 = to_u32(digest + 4);
+    h2 = to_u32(digest + 8);
+    h3 = to_u32(digest + 12);
+    for (; nblocks > 0; nblocks--, blocks += 64) {
         // break into 16 32-bit dwords
         for (i32 i = 0; i < 16; i++) {
-            dwords[i] = to_u32((ctx->buffer + offset) + i * 4);
+            dwords[i] = to_u32(blocks + i * 4);
         }
 
         a = h0;
@@ -89,7 +92,7 @@ void md5_digest(t_context *ctx) {
             pivot = d;
             d = c;
             c = b;
-            b = b + LEFTROTATE((a + f + k[i] + dwords[g]), s[i]);
+            b = b + LEFTROTATE((a + f + md5_k[i] + dwords[g]), md5_s[i]);
             a = pivot;
         }
 
@@ -100,14 +103,70 @@ void md5_digest(t_context *ctx) {
         h3 += d;
     }
     // store the result in the digest
-    to_bytes(h0, ctx->digest);
-    to_bytes(h1, ctx->digest + 4);
-    to_bytes(h2, ctx->digest + 8);
-    to_bytes(h3, ctx->digest + 12);
+    to_bytes(h0, digest);
+    to_bytes(h1, digest + 4);
+    to_bytes(h2, digest + 8);
+    to_bytes(h3, digest + 12);
 }
 
 /**
- * @brief Finalize the MD5 hash function, runs post-processing steps
+ * @brief Same as md5_digest, with the 64 steps written out
+ * 
+ * @note No branches, no tables: every step has its round function, dword index, constant and shift
+ * known at compile time, and the variables rotate by renaming instead of being moved around
+ * 
+ * @param digest Intermediate hash value (4 little endian 32-bit words)
+ * @param blocks Message blocks, read in place
+ * @param nblocks Number of 64-byte blocks to compress
+ */
+void md5_digest_unrolled(byte *digest, const byte *blocks, u64 nblocks) {
+    u32 m[16];
+    u32 a, b, c, d;
+    u32 h0 = LOAD_LE32(digest);
+    u32 h1 = LOAD_LE32(digest + 4);
+    u32 h2 = LOAD_LE32(digest + 8);
+    u32 h3 = LOAD_LE32(digest + 12);
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        for (i32 i = 0; i < 16; i++) {
+            m[i] = LOAD_LE32(blocks + i * 4);
+        }
+        a = h0;
+        b = h1;
+        c = h2;
+        d = h3;
+
+        MD5_STEPS(m);
+
+        h0 += a;
+        h1 += b;
+        h2 += c;
+        h3 += d;
+    }
+    to_bytes(h0, digest);
+    to_bytes(h1, digest + 4);
+    to_bytes(h2, digest + 8);
+    to_bytes(h3, digest + 12);
+}
+
+// Digest implementations, fastest first
+static const t_kernel _md5_kernels[] = {
+    {"unrolled", 0, md5_digest_unrolled},
+    {"scalar", 0, md5_digest},
+    {NULL, 0, NULL}
+};
+
+/**
+ * @brief Returns every MD5 digest implementation, fastest first
+ * 
+ * @return const t_kernel* NULL-terminated kernel table
+ */
+const t_kernel *md5_kernels(void) {
+    return (_md5_kernels);
+}
+
+/**
+ * @brief Pads the message in the internal buffer, without digesting it
  * 
  * @note MD5 post-processing steps:
  * 1. Append a 1 bit to the message
@@ -116,22 +175,28 @@ void md5_digest(t_context *ctx) {
  * 
  * @param ctx Hash context
  */
-void md5_final(t_context *ctx) {
+void md5_pad(t_context *ctx) {
     // append 1-bit
-    u32 initial_length = ctx->chomped_bytes;
+    u64 bits = ctx->chomped_bytes * 8;
     ctx->buffer[ctx->buffer_size++] = 0b10000000;
-    u32 msg_length = ctx->buffer_size;
     // pad with 0s to make the message congruent to 448 (mod 512)
-    while (msg_length % 64 != 56) {
-        ctx->buffer[ctx->buffer_size] = 0b00000000;
-        msg_length++;
-        ctx->buffer_size++;
+    while (ctx->buffer_size % 64 != 56) {
+        ctx->buffer[ctx->buffer_size++] = 0b00000000;
     }
-    // append length
-    to_bytes(initial_length << 3, ctx->buffer + ctx->buffer_size);
-    to_bytes(initial_length >> (32-3), ctx->buffer + ctx->buffer_size + 4);
+    // append 64-bit length, little endian
+    to_bytes((u32) bits, ctx->buffer + ctx->buffer_size);
+    to_bytes((u32) (bits >> 32), ctx->buffer + ctx->buffer_size + 4);
     ctx->buffer_size += 8;
-    ctx->digest_fn(ctx);
+}
+
+/**
+ * @brief Finalize the MD5 hash function, runs post-processing steps
+ * 
+ * @param ctx Hash context
+ */
+void md5_final(t_context *ctx) {
+    md5_pad(ctx);
+    ctx->digest_fn(ctx->digest, ctx->buffer, ctx->buffer_size / MD5_BLOCK_SIZE);
 }
 
 /**
@@ -143,7 +208,7 @@ void md5_reset(t_context *ctx) {
     ctx->chomped_bytes = 0;
     ctx->stream_finished = false;
     ctx->buffer_size = 0;
-    ft_memcpy(ctx->digest, _md5_initial_digest, MD5_DIGEST_SIZE);
+    ft_memcpy(ctx->digest, md5_initial_digest, MD5_DIGEST_SIZE);
 }
 
 /**
@@ -159,14 +224,17 @@ void md5_reset(t_context *ctx) {
 t_context md5_init(u64 known_size) {
     t_context new_ctx;
     new_ctx.chomped_bytes = 0;
-    new_ctx.digest_fn = md5_digest;
+    new_ctx.digest_fn = kernel_select(_md5_kernels)->digest_fn;
     new_ctx.final_fn = md5_final;
     new_ctx.reset_fn = md5_reset;
+    new_ctx.pad_fn = md5_pad;
+    new_ctx.output_fn = NULL;
+    new_ctx.mb_kernel = md5_mb_kernel();
     new_ctx.digest_size = MD5_DIGEST_SIZE;
     new_ctx.buffer_size = 0;
     new_ctx.known_size = known_size;
     new_ctx.stream_finished = false;
     new_ctx.alg_name = MD5_ALG_NAME;
-    ft_memcpy(new_ctx.digest, _md5_initial_digest, MD5_DIGEST_SIZE);   
+    ft_memcpy(new_ctx.digest, md5_initial_digest, MD5_DIGEST_SIZE);   
     return new_ctx;
 }
\ No newline at end of file
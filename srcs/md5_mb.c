@@ -0,0 +1,60 @@
+#include "ft_ssl.h"
+#include "md5_steps.h"
+
+// Multi-buffer MD5, hashes several independent messages at once (one per SIMD lane)
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define MB_LANES 4
+#define MB_TARGET "sse2"
+#define MB_NAME md5_x4_sse2
+#include "md5_mb_kernel.h"
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_NAME
+
+#define MB_LANES 8
+#define MB_TARGET "avx2"
+#define MB_NAME md5_x8_avx2
+#include "md5_mb_kernel.h"
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_NAME
+
+#define MB_LANES 16
+#define MB_TARGET "avx512f"
+#define MB_NAME md5_x16_avx512
+#include "md5_mb_kernel.h"
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_NAME
+
+#endif
+
+// Multi-buffer implementations, widest first
+static const t_mb_kernel _md5_mb_kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx512-x16", CPU_AVX512F, 16, md5_x16_avx512},
+    {"avx2-x8", CPU_AVX2, 8, md5_x8_avx2},
+    {"sse2-x4", CPU_SSE2, 4, md5_x4_sse2},
+#endif
+    {NULL, 0, 0, NULL}
+};
+
+/**
+ * @brief Returns the widest multi-buffer MD5 implementation this CPU can run
+ *
+ * @return const t_mb_kernel* The kernel, NULL if there is none
+ */
+const t_mb_kernel *md5_mb_kernel(void) {
+    return (mb_kernel_select(_md5_mb_kernels));
+}
+
+/**
+ * @brief Returns every multi-buffer MD5 implementation, widest first
+ *
+ * @return const t_mb_kernel* NULL-terminated kernel table
+ */
+const t_mb_kernel *md5_mb_kernels(void) {
+    return (_md5_mb_kernels);
+}
@@ -0,0 +1,87 @@
+/**
+ * Multi-buffer MD5 compression function, "instantiated" once per vector width by md5_mb.c:
+ * - MB_LANES: number of 32-bit lanes (independent messages)
+ * - MB_TARGET: instruction set the function is compiled for
+ * - MB_NAME: name of the generated function
+ *
+ * Every lane holds one message, lane `l` of each vector is dword `i` of message `l`, so the 64 rounds run
+ * for all the messages at once, using GCC's vector extensions (lowered to SSE2 / AVX2 / AVX-512 by MB_TARGET).
+*/
+
+#define MB_VEC MB_CONCAT(MB_NAME, _vec)
+#define MB_CONCAT(a, b) MB_CONCAT_(a, b)
+#define MB_CONCAT_(a, b) a##b
+
+typedef u32 MB_VEC __attribute__((vector_size(MB_LANES * 4)));
+
+/**
+ * @brief Runs nblocks compressions on up to MB_LANES messages at once
+ *
+ * @param digests Intermediate hash value of each lane (4 little endian 32-bit words), NULL for an unused lane
+ * @param data Message blocks of each lane, ignored for unused lanes
+ * @param nblocks Number of 64-byte blocks to process, the same for every lane
+ */
+__attribute__((target(MB_TARGET)))
+void MB_NAME(byte **digests, const byte **data, u64 nblocks) {
+    static const byte unused_block[MD5_BLOCK_SIZE] = {0};
+    const byte *p[MB_LANES];
+    u64 stride[MB_LANES];
+    MB_VEC state[4], dwords[16], a, b, c, d;
+    u32 word, lane_words[MB_LANES];
+
+    // transpose the states, unused lanes hash a zero block that never moves
+    for (i32 l = 0; l < MB_LANES; l++) {
+        for (i32 i = 0; i < 4; i++) {
+            word = 0;
+            if (digests[l] != NULL) {
+                __builtin_memcpy(&word, digests[l] + i * 4, 4);
+            }
+            state[i][l] = word;
+        }
+        p[l] = digests[l] != NULL ? data[l] : unused_block;
+        stride[l] = digests[l] != NULL ? MD5_BLOCK_SIZE : 0;
+    }
+
+    for (; nblocks > 0; nblocks--) {
+        // break into 16 32-bit dwords, one message per lane
+#pragma GCC unroll 16
+        for (i32 i = 0; i < 16; i++) {
+#pragma GCC unroll 16
+            for (i32 l = 0; l < MB_LANES; l++) {
+                __builtin_memcpy(&lane_words[l], p[l] + i * 4, 4);
+            }
+            __builtin_memcpy(&dwords[i], lane_words, sizeof(lane_words));
+        }
+        for (i32 l = 0; l < MB_LANES; l++) {
+            p[l] += stride[l];
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+
+        // the steps of md5_digest_unrolled on every lane: constants and shifts are immediates
+        MD5_STEPS(dwords);
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+
+    // transpose back
+    for (i32 l = 0; l < MB_LANES; l++) {
+        if (digests[l] == NULL) {
+            continue;
+        }
+        for (i32 i = 0; i < 4; i++) {
+            word = state[i][l];
+            __builtin_memcpy(digests[l] + i * 4, &word, 4);
+        }
+    }
+}
+
+#undef MB_VEC
+#undef MB_CONCAT
+#undef MB_CONCAT_
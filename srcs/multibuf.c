@@ -0,0 +1,444 @@
+#include "ft_ssl.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Multi-buffer hashing of a file list: each SIMD lane of the context's mb_kernel owns a file,
+ * lanes read their file BUFFER_SIZE bytes at a time into their own buffer, and the blocks of
+ * every lane are compressed together, straight from these buffers. When a lane is done, it gets
+ * the next file of the list.
+ *
+ * When io_uring is available, reads are asynchronous: every lane has a second buffer that is
+ * filled while the first one is compressed, so up to one read per lane is in flight. Without a
+ * multi-buffer kernel, lanes are still used to keep reads in flight, each file being compressed
+ * on its own.
+ *
+ * If the ring breaks, it is closed and the lanes go on with read(): regular files from the offset of
+ * the reads that completed, the others can't be read again and fail.
+ *
+ * Files don't finish in order, so digests wait in a window of MB_WINDOW results until every
+ * file before them has been printed.
+*/
+
+typedef struct s_lane {
+    t_context ctx;                      // Hash context of the file being hashed
+    i32 index;                          // Index of the file in the list, -1 if the lane is idle
+    i32 fd;                             // File descriptor of the file
+    char *path;                         // Path of the file, for --stats
+    u64 start;                          // Value of stats_ticks before the file was opened, for --stats
+    byte buffers[2][BUFFER_SIZE + BLOCK_SIZE * 2]; // Bytes read from the file + space for padding, the second one is only used with io_uring
+    u32 sizes[2];                       // Number of bytes in each buffer
+    bool ready[2];                      // True once a buffer is filled (whole buffer, or the end of the file)
+    bool last[2];                       // True if a buffer holds the end of the file (it is padded)
+    u8 cur;                             // Buffer being compressed
+    u32 offset;                         // Offset of the next block to compress in the current buffer
+    u64 file_size;                      // Size of the file when it was opened
+    u64 read_offset;                    // Offset of the next read in the file
+    bool read_deferred;                 // A read is due but its buffer is still being compressed
+    bool failed;                        // True if a read failed
+} t_lane;
+
+typedef struct s_mb_result {
+    byte digest[MAX_DIGEST_SIZE];       // The final hash value
+    u8 status;                          // FILE_* status of the file
+} t_mb_result;
+
+// Lanes used when there is no multi-buffer kernel but reads can still be overlapped
+static const t_mb_kernel _no_kernel = {"none", 0, 8, NULL};
+
+static t_lane _lanes[MB_MAX_LANES];
+static t_mb_result _results[MB_WINDOW];
+static t_uring _ring;
+
+/**
+ * @brief Appends the padding to the buffer holding the end of the file
+ *
+ * @param lane Busy lane
+ * @param b Buffer index, every byte of the file is in it
+ */
+static void _lane_pad(t_lane *lane, u8 b) {
+    t_context *ctx = &lane->ctx;
+    u32 tail = lane->sizes[b] % BLOCK_SIZE;
+
+    // the padding function works on the context's buffer, lend it the incomplete block
+    ft_memcpy(ctx->buffer, lane->buffers[b] + lane->sizes[b] - tail, tail);
+    ctx->buffer_size = tail;
+    ctx->pad_fn(ctx);
+    ft_memcpy(lane->buffers[b] + lane->sizes[b] - tail, ctx->buffer, ctx->buffer_size);
+    lane->sizes[b] += ctx->buffer_size - tail;
+    lane->last[b] = true;
+}
+
+/**
+ * @brief Queues the read of what buffer b is missing
+ *
+ * @param lane Busy lane
+ * @param b Buffer index
+ */
+static void _lane_submit(t_lane *lane, u8 b) {
+    uring_read(&_ring, lane->fd, lane->buffers[b] + lane->sizes[b], BUFFER_SIZE - lane->sizes[b],
+        lane->read_offset, (lane - _lanes) * 2 + b, (lane - _lanes) * 2 + b);
+}
+
+/**
+ * @brief Gives a file to an idle lane
+ *
+ * @param lane Idle lane
+ * @param path Path of the file
+ * @param index Index of the file in the list
+ * @return true The file has been opened, false otherwise (the result is already set)
+ */
+static bool _lane_open(t_lane *lane, char *path, i32 index) {
+    t_mb_result *result = &_results[index % MB_WINDOW];
+    struct stat st;
+
+    result->status = FILE_PENDING;
+    lane->start = STATS_START();
+    lane->fd = open(path, O_RDONLY);
+    STATS_STOP(STATS_READ, lane->start);
+    STATS_COUNT(STATS_OPENS, 1);
+    if (lane->fd == -1) {
+        result->status = FILE_NOT_FOUND;
+        return (false);
+    }
+    lane->ctx.reset_fn(&lane->ctx);
+    lane->index = index;
+    lane->path = path;
+    lane->sizes[0] = 0;
+    lane->sizes[1] = 0;
+    lane->ready[0] = false;
+    lane->ready[1] = false;
+    lane->last[0] = false;
+    lane->last[1] = false;
+    lane->cur = 0;
+    lane->offset = 0;
+    // pipes and special files have no size, their end is only known when a read returns 0
+    lane->file_size = fstat(lane->fd, &st) == 0 && S_ISREG(st.st_mode) ? (u64) st.st_size : (u64) -1;
+    lane->read_offset = 0;
+    lane->read_deferred = false;
+    lane->failed = false;
+    if (_ring.fd != -1) {
+        _lane_submit(lane, 0);
+    }
+    return (true);
+}
+
+/**
+ * @brief Releases a lane, storing its result
+ *
+ * @param lane Busy lane
+ * @param status FILE_* status of the file
+ */
+static void _lane_close(t_lane *lane, u8 status) {
+    t_mb_result *result = &_results[lane->index % MB_WINDOW];
+    if (status == FILE_DONE) {
+        if (lane->ctx.output_fn != NULL) {
+            lane->ctx.output_fn(&lane->ctx);
+        }
+        ft_memcpy(result->digest, lane->ctx.digest, lane->ctx.digest_size);
+        // files share the lanes, the time reported is from open to close, the other files' included
+        if (stats_enabled) {
+            stats_file(lane->path, lane->ctx.chomped_bytes, lane->start);
+        }
+    }
+    result->status = status;
+    close(lane->fd);
+    lane->index = -1;
+}
+
+/**
+ * @brief Fills the current buffer of a lane with read(), pads it if the end of the file has been reached
+ *
+ * @note Regular files are read at read_offset, where the reads of a broken ring stopped
+ *
+ * @param lane Busy lane, every block of its buffer has been compressed
+ */
+static void _lane_fill(t_lane *lane) {
+    i64 bytes_read;
+    u8 b = lane->cur;
+
+    while (lane->sizes[b] < BUFFER_SIZE) {
+        u64 start = STATS_START();
+        if (lane->file_size != (u64) -1) {
+            bytes_read = pread(lane->fd, lane->buffers[b] + lane->sizes[b], BUFFER_SIZE - lane->sizes[b], lane->read_offset);
+        } else {
+            bytes_read = read(lane->fd, lane->buffers[b] + lane->sizes[b], BUFFER_SIZE - lane->sizes[b]);
+        }
+        STATS_STOP(STATS_READ, start);
+        STATS_COUNT(STATS_READS, 1);
+        if (bytes_read == -1) {
+            lane->failed = true;
+            return ;
+        } else if (bytes_read == 0) {
+            break;
+        }
+        lane->sizes[b] += bytes_read;
+        lane->read_offset += bytes_read;
+        lane->ctx.chomped_bytes += bytes_read;
+        STATS_COUNT(STATS_BYTES, bytes_read);
+    }
+    if (lane->sizes[b] < BUFFER_SIZE) {
+        _lane_pad(lane, b);
+    }
+    lane->ready[b] = true;
+}
+
+/**
+ * @brief Handles a completed read: pads at the end of the file, reads the rest of a short read,
+ * or starts reading ahead in the other buffer
+ *
+ * @param lane Busy lane
+ * @param b Buffer the read landed in
+ * @param res Result of the read
+ */
+static void _lane_complete(t_lane *lane, u8 b, i32 res) {
+    STATS_COUNT(STATS_READS, 1);
+    if (res < 0) {
+        lane->failed = true;
+        return ;
+    }
+    lane->sizes[b] += res;
+    lane->read_offset += res;
+    lane->ctx.chomped_bytes += res;
+    STATS_COUNT(STATS_BYTES, res);
+    // regular files end at the size they had when opened, no need to wait for a read of 0 bytes
+    if (res == 0 || lane->read_offset >= lane->file_size) {
+        _lane_pad(lane, b);
+        lane->ready[b] = true;
+    } else if (lane->sizes[b] < BUFFER_SIZE) {
+        _lane_submit(lane, b);
+    } else {
+        lane->ready[b] = true;
+        // the other buffer is free once compressed
+        if (lane->cur == b) {
+            _lane_submit(lane, !b);
+        } else {
+            lane->read_deferred = true;
+        }
+    }
+}
+
+/**
+ * @brief Moves a lane whose current buffer is compressed to its next buffer
+ *
+ * @param lane Busy lane, not at the end of its file
+ */
+static void _lane_next(t_lane *lane) {
+    u8 b = lane->cur;
+
+    lane->sizes[b] = 0;
+    lane->ready[b] = false;
+    lane->last[b] = false;
+    lane->offset = 0;
+    if (_ring.fd == -1) {
+        // a read ahead that completed before the ring broke
+        lane->cur = lane->ready[!b] ? !b : b;
+        return ;
+    }
+    lane->cur = !b;
+    if (lane->read_deferred) {
+        lane->read_deferred = false;
+        _lane_submit(lane, b);
+    }
+}
+
+/**
+ * @brief Closes a ring that failed, the reads it had in flight are read again with read()
+ *
+ * @note A lane waits on at most one read: into its current buffer, or ahead into the other one once
+ * the current one is ready. A read ahead that didn't complete is dropped, the buffer is read again
+ * later. Closing the ring cancels what's still in flight.
+ *
+ * @param kernel Multi-buffer kernel
+ */
+static void _lanes_recover(const t_mb_kernel *kernel) {
+    uring_destroy(&_ring);
+    for (i32 l = 0; l < kernel->lanes; l++) {
+        t_lane *lane = &_lanes[l];
+        u8 other = !lane->cur;
+        if (lane->index == -1 || lane->failed) {
+            continue;
+        }
+        bool in_flight = !lane->ready[lane->cur] || (!lane->last[lane->cur] && !lane->ready[other]);
+        // what a pipe had in flight is gone
+        if (lane->file_size == (u64) -1 && in_flight) {
+            lane->failed = true;
+            continue;
+        }
+        if (lane->ready[lane->cur] && in_flight) {
+            lane->read_offset -= lane->sizes[other];
+            lane->ctx.chomped_bytes -= lane->sizes[other];
+            lane->sizes[other] = 0;
+        }
+        lane->read_deferred = false;
+    }
+}
+
+/**
+ * @brief Waits until the current buffer of every busy lane is ready
+ *
+ * @param kernel Multi-buffer kernel
+ */
+static void _lanes_wait(const t_mb_kernel *kernel) {
+    u64 user_data;
+    i32 res, waiting;
+
+    while (true) {
+        waiting = 0;
+        for (i32 l = 0; l < kernel->lanes; l++) {
+            t_lane *lane = &_lanes[l];
+            if (lane->index == -1 || lane->failed || lane->ready[lane->cur]) {
+                continue;
+            }
+            if (_ring.fd == -1) {
+                _lane_fill(lane);
+            } else {
+                waiting++;
+            }
+        }
+        if (waiting == 0) {
+            return ;
+        }
+        u64 start = STATS_START();
+        bool completed = uring_wait(&_ring, &user_data, &res);
+        STATS_STOP(STATS_READ, start);
+        if (!completed) {
+            // the next turn reads what's missing with read()
+            _lanes_recover(kernel);
+            continue;
+        }
+        _lane_complete(&_lanes[user_data / 2], user_data % 2, res);
+    }
+}
+
+/**
+ * @brief Compresses the remaining blocks of a lane with the single-buffer digest function
+ *
+ * @param lane Busy lane
+ */
+static void _lane_digest(t_lane *lane) {
+    u32 size = lane->sizes[lane->cur];
+    lane->ctx.digest_fn(lane->ctx.digest, lane->buffers[lane->cur] + lane->offset, (size - lane->offset) / BLOCK_SIZE);
+    lane->offset = size;
+}
+
+/**
+ * @brief Compresses the blocks every busy lane has in common
+ *
+ * @param kernel Multi-buffer kernel
+ * @param active Number of busy lanes
+ */
+static void _lanes_digest(const t_mb_kernel *kernel, i32 active) {
+    byte *digests[MB_MAX_LANES];
+    const byte *data[MB_MAX_LANES];
+    u64 nblocks = (u64) -1, start = STATS_START();
+    t_lane *lane;
+
+    for (i32 l = 0; l < kernel->lanes; l++) {
+        digests[l] = NULL;
+        data[l] = NULL;
+        if (_lanes[l].index == -1) {
+            continue;
+        }
+        lane = &_lanes[l];
+        digests[l] = lane->ctx.digest;
+        data[l] = lane->buffers[lane->cur] + lane->offset;
+        if ((lane->sizes[lane->cur] - lane->offset) / BLOCK_SIZE < nblocks) {
+            nblocks = (lane->sizes[lane->cur] - lane->offset) / BLOCK_SIZE;
+        }
+    }
+    // with most lanes idle, the single-buffer kernel is faster, run it on each busy lane
+    if (kernel->digest_fn == NULL || MB_FEW_LANES(active, kernel->lanes)) {
+        for (i32 l = 0; l < kernel->lanes; l++) {
+            if (_lanes[l].index != -1) {
+                _lane_digest(&_lanes[l]);
+            }
+        }
+        STATS_STOP(STATS_DIGEST, start);
+        return ;
+    }
+    kernel->digest_fn(digests, data, nblocks);
+    STATS_STOP(STATS_DIGEST, start);
+    for (i32 l = 0; l < kernel->lanes; l++) {
+        if (_lanes[l].index != -1) {
+            _lanes[l].offset += nblocks * BLOCK_SIZE;
+        }
+    }
+}
+
+/**
+ * @brief Hashes a list of files with the multi-buffer kernel of the context, prints digests in order
+ *
+ * @note The context is only used as a template for the lanes and to print
+ *
+ * @param ctx Hash context
+ * @param paths Paths of the files to hash
+ * @param count Number of files
+ * @param flags Output flags
+ * @return true The files have been hashed, false if there's neither a multi-buffer kernel nor io_uring (nothing done)
+ */
+bool mb_hash_files(t_context *ctx, char **paths, i32 count, u8 flags) {
+    const t_mb_kernel *kernel = ctx->mb_kernel != NULL ? ctx->mb_kernel : &_no_kernel;
+    byte *buffers[MB_MAX_LANES * 2];
+    i32 next = 0, head = 0, active;
+
+    for (i32 l = 0; l < MB_MAX_LANES; l++) {
+        buffers[l * 2] = _lanes[l].buffers[0];
+        buffers[l * 2 + 1] = _lanes[l].buffers[1];
+    }
+    if (!uring_init(&_ring, MB_MAX_LANES * 2, buffers, MB_MAX_LANES * 2, sizeof(_lanes[0].buffers[0])) && ctx->mb_kernel == NULL) {
+        return (false);
+    }
+    for (i32 l = 0; l < kernel->lanes; l++) {
+        _lanes[l].ctx = *ctx;
+        _lanes[l].index = -1;
+    }
+    while (head < count) {
+        for (i32 l = 0; l < kernel->lanes; l++) {
+            t_lane *lane = &_lanes[l];
+            // give a file to idle lanes, as long as there's room in the window
+            while (lane->index == -1 && next < count && next - head < MB_WINDOW) {
+                _lane_open(lane, paths[next], next);
+                next++;
+            }
+        }
+        _lanes_wait(kernel);
+        active = 0;
+        for (i32 l = 0; l < kernel->lanes; l++) {
+            if (_lanes[l].index != -1 && _lanes[l].failed) {
+                _lane_close(&_lanes[l], FILE_READ_FAILED);
+            } else if (_lanes[l].index != -1) {
+                active++;
+            }
+        }
+        if (active > 0) {
+            _lanes_digest(kernel, active);
+        }
+        for (i32 l = 0; l < kernel->lanes; l++) {
+            t_lane *lane = &_lanes[l];
+            if (lane->index == -1 || lane->offset != lane->sizes[lane->cur]) {
+                continue;
+            }
+            if (lane->last[lane->cur]) {
+                _lane_close(lane, FILE_DONE);
+            } else {
+                _lane_next(lane);
+            }
+        }
+        // print what can be printed, in order
+        for (; head < next && _results[head % MB_WINDOW].status != FILE_PENDING; head++) {
+            t_mb_result *result = &_results[head % MB_WINDOW];
+            if (result->status == FILE_NOT_FOUND) {
+                print_error(ERR_FILE_NOT_FOUND, paths[head]);
+            } else if (result->status == FILE_READ_FAILED) {
+                print_error(ERR_FILE_READ_FAILED, paths[head]);
+            } else {
+                ft_memcpy(ctx->digest, result->digest, ctx->digest_size);
+                ctx_print_digest(ctx, paths[head], true, flags);
+            }
+        }
+    }
+    uring_destroy(&_ring);
+    return (true);
+}
@@ -0,0 +1,69 @@
+#include "ft_ssl.h"
+#include <errno.h>
+#include <unistd.h>
+
+/**
+ * Buffered standard output: digests, -p echoes and -c results are appended to one buffer, written
+ * in OUTPUT_BUFFER_SIZE writes instead of a write per fragment. print_error flushes it before writing
+ * to stderr, so results and errors still come out in order. Only the main thread prints.
+*/
+
+static byte _output[OUTPUT_BUFFER_SIZE];
+static u64 _output_size = 0;
+
+/**
+ * @brief Writes all of a buffer to stdout, retrying short writes
+ */
+static void _output_write_all(const byte *s, u64 len) {
+    while (len > 0) {
+        STATS_COUNT(STATS_WRITES, 1);
+        i64 written = ft_putstr_fd(1, s, len);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            return ;
+        }
+        s += written;
+        len -= written;
+    }
+}
+
+/**
+ * @brief Writes what has been buffered so far to stdout
+ */
+void output_flush(void) {
+    _output_write_all(_output, _output_size);
+    _output_size = 0;
+}
+
+/**
+ * @brief Encodes bytes into hex straight into the output buffer
+ *
+ * @param in Bytes to encode, a digest: size * 2 must be less than OUTPUT_BUFFER_SIZE
+ * @param size Number of bytes
+ */
+void output_hex(const byte *in, u64 size) {
+    if (_output_size + size * 2 > OUTPUT_BUFFER_SIZE) {
+        output_flush();
+    }
+    hex_encode(in, (char *) _output + _output_size, size);
+    _output_size += size * 2;
+}
+
+/**
+ * @brief Appends to the output buffer, flushes it when full
+ *
+ * @param s Bytes to print
+ * @param len Number of bytes, anything larger than the buffer is written straight through
+ */
+void output_write(const void *s, i64 len) {
+    if (_output_size + len > OUTPUT_BUFFER_SIZE) {
+        output_flush();
+    }
+    if (len >= OUTPUT_BUFFER_SIZE) {
+        _output_write_all(s, len);
+        return ;
+    }
+    ft_memcpy(_output + _output_size, s, len);
+    _output_size += len;
+}
@@ -0,0 +1,383 @@
+#include "ft_ssl.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * PBKDF2-HMAC-SHA256 (RFC 8018). A derived key is made of 32-byte blocks T_i, each one the XOR of
+ * a chain of HMACs: U_1 = HMAC(P, S || i), U_j = HMAC(P, U_{j-1}). Every chain is independent, so
+ * the chains of every block of every password are handed out to the lanes of the multi-buffer
+ * kernel, a batch of lanes at a time, and the batches to the threads.
+ *
+ * Past U_1, every message of a chain is 32 bytes long: an HMAC is two compressions of one block
+ * whose padding never changes, starting from the states of the password's ipad and opad blocks.
+ * The loop writes U straight into its block and compresses it, without the context's buffer.
+*/
+
+#define PBKDF2_MAX_KEY_LENGTH 1024 // bytes, 32 blocks
+#define PBKDF2_MAX_ITERATIONS 100000000
+#define PBKDF2_READ_SIZE 65536 // bytes of stdin read at a time for the passwords
+
+typedef struct s_pbkdf2 {
+    const byte *salt;
+    u32 salt_size;
+    u64 iterations;
+    u32 key_length;                     // Bytes per derived key
+    u32 blocks;                         // Blocks of SHA256_DIGEST_SIZE bytes per derived key
+    char **passwords;
+    u32 *password_sizes;
+    u64 count;                          // Number of passwords
+    byte *keys;                         // count * key_length bytes
+    const t_mb_kernel *kernel;          // NULL: one chain at a time with the single-buffer kernel
+    u8 lanes;                           // Chains of a batch
+    u8 min_lanes;                       // Smaller batches are run one chain at a time
+    u64 batches;
+    u64 next_batch;                     // Taken atomically by the threads
+} t_pbkdf2;
+
+/**
+ * One chain, in a lane
+*/
+typedef struct s_chain {
+    byte ipad[SHA256_DIGEST_SIZE];      // State after the password ^ ipad block
+    byte opad[SHA256_DIGEST_SIZE];      // State after the password ^ opad block
+    byte state[SHA256_DIGEST_SIZE];     // Compressed in place
+    byte inner[SHA256_BLOCK_SIZE];      // U, padded as a 96-byte message (the key block is already compressed)
+    byte outer[SHA256_BLOCK_SIZE];      // Inner hash, padded the same way
+    u32 t[SHA256_DIGEST_SIZE / 4];      // XOR of the U so far
+    u64 index;                          // Chain number: password * blocks + block
+} t_chain;
+
+static inline void _store_be32(byte *p, u32 x) {
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+/**
+ * @brief Writes a state as a digest (big-endian words) at the start of a block
+ */
+static inline void _pbkdf2_output(byte *block, const byte *state) {
+    for (u32 w = 0; w < SHA256_DIGEST_SIZE / 4; w++) {
+        _store_be32(block + w * 4, to_u32(state + w * 4));
+    }
+}
+
+/**
+ * @brief Pads a block holding a 32-byte message, after the 64 bytes of the key block
+ */
+static void _pbkdf2_pad(byte *block) {
+    ft_memset(block + SHA256_DIGEST_SIZE, 0, SHA256_BLOCK_SIZE - SHA256_DIGEST_SIZE);
+    block[SHA256_DIGEST_SIZE] = 0x80;
+    // the length is in bits
+    _store_be32(block + SHA256_BLOCK_SIZE - 4, (SHA256_BLOCK_SIZE + SHA256_DIGEST_SIZE) * 8);
+}
+
+/**
+ * @brief Keys the lane with its password, computes U_1 the regular way
+ */
+static void _pbkdf2_chain_start(const t_pbkdf2 *kdf, t_chain *chain, u64 index) {
+    u64 password = index / kdf->blocks;
+    byte block_index[4];
+    t_context ctx;
+    t_hmac hmac;
+
+    hmac_init(&hmac, sha256_init, (byte *) kdf->passwords[password], kdf->password_sizes[password]);
+    ft_memcpy(chain->ipad, hmac.inner.digest, SHA256_DIGEST_SIZE);
+    ft_memcpy(chain->opad, hmac.outer.digest, SHA256_DIGEST_SIZE);
+    ctx = hmac.inner;
+    hmac_start(&hmac, &ctx);
+    ctx_chomp(&ctx, kdf->salt, kdf->salt_size);
+    _store_be32(block_index, index % kdf->blocks + 1);
+    ctx_chomp(&ctx, block_index, 4);
+    hmac_final(&hmac, &ctx);
+    ft_memcpy(chain->inner, ctx.digest, SHA256_DIGEST_SIZE);
+    for (u32 w = 0; w < SHA256_DIGEST_SIZE / 4; w++) {
+        chain->t[w] = LOAD_BE32(ctx.digest + w * 4);
+    }
+    _pbkdf2_pad(chain->inner);
+    _pbkdf2_pad(chain->outer);
+    chain->index = index;
+}
+
+/**
+ * @brief Stores the block of the derived key a chain computed, the last one may be cut short
+ */
+static void _pbkdf2_chain_end(t_pbkdf2 *kdf, const t_chain *chain) {
+    u64 block = chain->index % kdf->blocks;
+    byte *key = kdf->keys + (chain->index / kdf->blocks) * kdf->key_length + block * SHA256_DIGEST_SIZE;
+    u32 size = kdf->key_length - block * SHA256_DIGEST_SIZE;
+    byte out[SHA256_DIGEST_SIZE];
+
+    for (u32 w = 0; w < SHA256_DIGEST_SIZE / 4; w++) {
+        _store_be32(out + w * 4, chain->t[w]);
+    }
+    ft_memcpy(key, out, size < SHA256_DIGEST_SIZE ? size : SHA256_DIGEST_SIZE);
+}
+
+/**
+ * @brief Runs the iterations 2..c of the chains of a batch, side by side in the lanes
+ *
+ * @param chains Chains of the batch
+ * @param count Number of busy lanes, the others are left idle
+ * @param kernel Multi-buffer kernel, NULL to run a single chain with digest_fn
+ * @param digest_fn Single-buffer kernel
+ */
+static void _pbkdf2_lanes(const t_pbkdf2 *kdf, t_chain *chains, u8 count, const t_mb_kernel *kernel, digest_func digest_fn) {
+    byte *states[MB_MAX_LANES] = {0};
+    const byte *inner[MB_MAX_LANES] = {0};
+    const byte *outer[MB_MAX_LANES] = {0};
+
+    for (u8 l = 0; l < count; l++) {
+        states[l] = chains[l].state;
+        inner[l] = chains[l].inner;
+        outer[l] = chains[l].outer;
+    }
+    for (u64 i = 1; i < kdf->iterations; i++) {
+        for (u8 l = 0; l < count; l++) {
+            ft_memcpy(chains[l].state, chains[l].ipad, SHA256_DIGEST_SIZE);
+        }
+        if (kernel != NULL) {
+            kernel->digest_fn(states, inner, 1);
+        } else {
+            digest_fn(states[0], inner[0], 1);
+        }
+        for (u8 l = 0; l < count; l++) {
+            _pbkdf2_output(chains[l].outer, chains[l].state);
+            ft_memcpy(chains[l].state, chains[l].opad, SHA256_DIGEST_SIZE);
+        }
+        if (kernel != NULL) {
+            kernel->digest_fn(states, outer, 1);
+        } else {
+            digest_fn(states[0], outer[0], 1);
+        }
+        for (u8 l = 0; l < count; l++) {
+            _pbkdf2_output(chains[l].inner, chains[l].state);
+            for (u32 w = 0; w < SHA256_DIGEST_SIZE / 4; w++) {
+                chains[l].t[w] ^= to_u32(chains[l].state + w * 4);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Takes batches of chains until there are none left
+ */
+static void *_pbkdf2_worker(void *arg) {
+    t_pbkdf2 *kdf = arg;
+    t_chain chains[MB_MAX_LANES];
+    digest_func digest_fn = sha256_init(0).digest_fn;
+    u64 batch, total = kdf->count * kdf->blocks;
+
+    while ((batch = __atomic_fetch_add(&kdf->next_batch, 1, __ATOMIC_RELAXED)) < kdf->batches) {
+        u64 first = batch * kdf->lanes;
+        u8 count = total - first < kdf->lanes ? total - first : kdf->lanes;
+        for (u8 l = 0; l < count; l++) {
+            _pbkdf2_chain_start(kdf, &chains[l], first + l);
+        }
+        if (kdf->kernel != NULL && count >= kdf->min_lanes) {
+            _pbkdf2_lanes(kdf, chains, count, kdf->kernel, digest_fn);
+        } else {
+            for (u8 l = 0; l < count; l++) {
+                _pbkdf2_lanes(kdf, &chains[l], 1, NULL, digest_fn);
+            }
+        }
+        for (u8 l = 0; l < count; l++) {
+            _pbkdf2_chain_end(kdf, &chains[l]);
+        }
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Derives the key of every password, on jobs threads
+ *
+ * @return true Success, false if the allocation failed
+ */
+static bool _pbkdf2_derive(t_pbkdf2 *kdf, i32 jobs) {
+    pthread_t threads[MAX_JOBS];
+    i32 started = 0;
+
+    kdf->kernel = sha256_mb_kernel();
+    kdf->lanes = kdf->kernel != NULL ? kdf->kernel->lanes : 1;
+    // a lane costs as much busy or idle, and the SHA extensions run a single chain at 80% of the
+    // speed of 16 lanes of AVX-512: only full batches are worth it then
+    kdf->min_lanes = IS_SET(cpu_features(), CPU_SHA) ? kdf->lanes : 2;
+    kdf->batches = (kdf->count * kdf->blocks + kdf->lanes - 1) / kdf->lanes;
+    kdf->next_batch = 0;
+    kdf->keys = malloc(kdf->count * kdf->key_length);
+    if (kdf->keys == NULL) {
+        return (false);
+    }
+    if ((u64) jobs > kdf->batches) {
+        jobs = kdf->batches;
+    }
+    // the main thread is one of the workers
+    for (; started < jobs - 1; started++) {
+        if (pthread_create(&threads[started], NULL, _pbkdf2_worker, kdf) != 0) {
+            break;
+        }
+    }
+    _pbkdf2_worker(kdf);
+    for (i32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return (true);
+}
+
+/**
+ * @brief Reads the passwords from stdin, one per line, at least one
+ *
+ * @return char* Buffer holding the passwords, NULL on error (already printed)
+ */
+static char *_pbkdf2_read_passwords(t_pbkdf2 *kdf) {
+    char *data = NULL;
+    u64 size = 0, capacity = 0, start = 0, lines = 0;
+    i64 bytes_read;
+
+    do {
+        if (size + PBKDF2_READ_SIZE > capacity) {
+            capacity = capacity > 0 ? capacity * 2 : PBKDF2_READ_SIZE * 2;
+            char *grown = realloc(data, capacity);
+            if (grown == NULL) {
+                print_error(ERR_MEM_ALLOC_FAILED, "pbkdf2");
+                free(data);
+                return (NULL);
+            }
+            data = grown;
+        }
+        bytes_read = read(0, data + size, PBKDF2_READ_SIZE);
+        size += bytes_read > 0 ? bytes_read : 0;
+    } while (bytes_read > 0);
+    if (bytes_read == -1) {
+        print_error(ERR_FILE_READ_FAILED, "(stdin)");
+        free(data);
+        return (NULL);
+    }
+    for (u64 i = 0; i < size; i++) {
+        lines += data[i] == '\n';
+    }
+    lines += size > 0 && data[size - 1] != '\n';
+    if (lines == 0) {
+        print_error(ERR_NO_PASSWORD, "(stdin)");
+        free(data);
+        return (NULL);
+    }
+    kdf->passwords = malloc(lines * sizeof(char *));
+    kdf->password_sizes = malloc(lines * sizeof(u32));
+    if (kdf->passwords == NULL || kdf->password_sizes == NULL) {
+        print_error(ERR_MEM_ALLOC_FAILED, "pbkdf2");
+        free(kdf->passwords);
+        free(kdf->password_sizes);
+        free(data);
+        return (NULL);
+    }
+    for (u64 i = 0; i <= size; i++) {
+        if (i == size ? i > start : data[i] == '\n') {
+            kdf->passwords[kdf->count] = data + start;
+            kdf->password_sizes[kdf->count++] = i - start;
+            start = i + 1;
+        }
+    }
+    return (data);
+}
+
+/**
+ * @brief Parses a decimal number of -i or -l
+ *
+ * @return true Success, false if it's not a number in [1, max]
+ */
+static bool _pbkdf2_number(char *value, u64 max, u64 *out) {
+    u64 n = 0;
+
+    if (value == NULL || *value == '\0') {
+        return (false);
+    }
+    for (i32 i = 0; value[i] != '\0'; i++) {
+        if (value[i] < '0' || value[i] > '9' || n > max) {
+            return (false);
+        }
+        n = n * 10 + value[i] - '0';
+    }
+    *out = n;
+    return (n >= 1 && n <= max);
+}
+
+/**
+ * @brief The pbkdf2 command: pbkdf2 -s SALT -i ITERATIONS [-l LENGTH] [-j N] [-p PASSWORD]
+ *
+ * @note Without -p, every line of stdin is a password, the keys are printed in the same order
+ *
+ * @param argc Number of arguments
+ * @param argv All passed arguments, the flags come after argv[1]
+ * @return int Exit code
+ */
+int pbkdf2_command(int argc, char **argv) {
+    t_pbkdf2 kdf = {.key_length = SHA256_DIGEST_SIZE};
+    t_options options = {0};
+    char *password = NULL, *salt = NULL, *data = NULL;
+    u64 iterations = 0, length = 0;
+    u32 password_size;
+
+    for (i32 i = 2; i < argc; i++) {
+        char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (ft_strcmp(argv[i], "-j") == 0) {
+            if (!parse_jobs(value, &options)) {
+                return (1);
+            }
+        } else if (ft_strcmp(argv[i], "-i") == 0 && iterations == 0) {
+            if (!_pbkdf2_number(value, PBKDF2_MAX_ITERATIONS, &iterations)) {
+                print_error(ERR_INVALID_ITERATIONS, value);
+                return (1);
+            }
+        } else if (ft_strcmp(argv[i], "-l") == 0 && length == 0) {
+            if (!_pbkdf2_number(value, PBKDF2_MAX_KEY_LENGTH, &length)) {
+                print_error(ERR_INVALID_KEY_LENGTH, value);
+                return (1);
+            }
+        } else if (ft_strcmp(argv[i], "-s") == 0 && salt == NULL && value != NULL) {
+            salt = value;
+        } else if (ft_strcmp(argv[i], "-p") == 0 && password == NULL && value != NULL) {
+            password = value;
+        } else {
+            print_error(ERR_INVALID_FLAG, "usage: pbkdf2 -s SALT -i ITERATIONS [-l LENGTH] [-j N] [-p PASSWORD]");
+            return (1);
+        }
+        i++;
+    }
+    if (salt == NULL || iterations == 0) {
+        print_error(ERR_INVALID_FLAG, "usage: pbkdf2 -s SALT -i ITERATIONS [-l LENGTH] [-j N] [-p PASSWORD]");
+        return (1);
+    }
+    if (options.jobs == 0) {
+        options.jobs = default_jobs();
+    }
+    kdf.salt = (byte *) salt;
+    kdf.salt_size = ft_strlen(salt);
+    kdf.iterations = iterations;
+    kdf.key_length = length > 0 ? length : SHA256_DIGEST_SIZE;
+    kdf.blocks = (kdf.key_length + SHA256_DIGEST_SIZE - 1) / SHA256_DIGEST_SIZE;
+    if (password != NULL) {
+        password_size = ft_strlen(password);
+        kdf.passwords = &password;
+        kdf.password_sizes = &password_size;
+        kdf.count = 1;
+    } else if ((data = _pbkdf2_read_passwords(&kdf)) == NULL) {
+        return (1);
+    }
+    if (!_pbkdf2_derive(&kdf, options.jobs)) {
+        print_error(ERR_MEM_ALLOC_FAILED, "pbkdf2");
+    }
+    for (u64 i = 0; i < kdf.count && kdf.keys != NULL; i++) {
+        output_hex(kdf.keys + i * kdf.key_length, kdf.key_length);
+        output_write("\n", 1);
+    }
+    output_flush();
+    if (data != NULL) {
+        free(kdf.passwords);
+        free(kdf.password_sizes);
+        free(data);
+    }
+    free(kdf.keys);
+    return (kdf.keys == NULL);
+}
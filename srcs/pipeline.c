@@ -0,0 +1,111 @@
+#include "ft_ssl.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Reader / hasher pipeline for a single stream (stdin, pipes): a reader thread fills a ring of
+ * buffers while the calling thread hashes them, so reading and compressing overlap. The reader
+ * blocks when every buffer is full (back-pressure), the hasher when every buffer is empty.
+*/
+
+typedef struct s_pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;            // Signaled when the hasher frees a buffer
+    pthread_cond_t not_empty;           // Signaled when the reader fills a buffer
+    byte *buffers;                      // depth buffers of PIPE_BUFFER_SIZE bytes
+    i64 *sizes;                         // Result of the read() of each buffer, 0 at the end, -1 on failure
+    u32 depth;                          // Number of buffers
+    u64 filled;                         // Number of buffers filled by the reader so far
+    u64 consumed;                       // Number of buffers hashed so far
+    i32 fd;                             // Stream to read
+} t_pipeline;
+
+/**
+ * @brief Number of buffers of the pipeline
+ *
+ * @note FT_SSL_PIPE_DEPTH can override PIPE_DEPTH, 0 or 1 disables the pipeline
+ *
+ * @return u32 Depth of the ring
+ */
+u32 pipeline_depth(void) {
+    char *depth = getenv("FT_SSL_PIPE_DEPTH");
+    if (depth == NULL) {
+        return (PIPE_DEPTH);
+    }
+    return ((u32) strtoul(depth, NULL, 10));
+}
+
+static void *_pipeline_reader(void *arg) {
+    t_pipeline *pipeline = arg;
+    i64 bytes_read;
+
+    do {
+        pthread_mutex_lock(&pipeline->lock);
+        while (pipeline->filled - pipeline->consumed == pipeline->depth) {
+            pthread_cond_wait(&pipeline->not_full, &pipeline->lock);
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+        // the buffer is ours until filled is bumped, no need to hold the lock while reading
+        u32 slot = pipeline->filled % pipeline->depth;
+        u64 start = STATS_START();
+        bytes_read = read(pipeline->fd, pipeline->buffers + (u64) slot * PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE);
+        STATS_STOP(STATS_READ, start);
+        STATS_COUNT(STATS_READS, 1);
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->sizes[slot] = bytes_read;
+        pipeline->filled++;
+        pthread_cond_signal(&pipeline->not_empty);
+        pthread_mutex_unlock(&pipeline->lock);
+    } while (bytes_read > 0);
+    return (NULL);
+}
+
+/**
+ * @brief Feeds the rest of a stream to the hash, a reader thread reading ahead up to depth buffers
+ *
+ * @param ctxs Hash contexts
+ * @param count Number of contexts
+ * @param fd Stream, read until the end
+ * @param depth Number of buffers, at least 2
+ * @param ok Set to false if reading failed
+ * @return true The stream has been read, false if the pipeline couldn't be started (nothing read)
+ */
+bool pipeline_chomp_fd(t_context *ctxs, i32 count, i32 fd, u32 depth, bool *ok) {
+    t_pipeline pipeline = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .not_full = PTHREAD_COND_INITIALIZER,
+        .not_empty = PTHREAD_COND_INITIALIZER,
+        .depth = depth,
+        .fd = fd,
+    };
+    pthread_t reader;
+    i64 size;
+
+    pipeline.buffers = malloc((u64) depth * PIPE_BUFFER_SIZE);
+    pipeline.sizes = malloc(depth * sizeof(i64));
+    if (pipeline.buffers == NULL || pipeline.sizes == NULL || pthread_create(&reader, NULL, _pipeline_reader, &pipeline) != 0) {
+        free(pipeline.buffers);
+        free(pipeline.sizes);
+        return (false);
+    }
+    do {
+        pthread_mutex_lock(&pipeline.lock);
+        while (pipeline.filled == pipeline.consumed) {
+            pthread_cond_wait(&pipeline.not_empty, &pipeline.lock);
+        }
+        size = pipeline.sizes[pipeline.consumed % depth];
+        pthread_mutex_unlock(&pipeline.lock);
+        if (size > 0) {
+            ctx_chomp_all(ctxs, count, pipeline.buffers + (pipeline.consumed % depth) * PIPE_BUFFER_SIZE, size);
+        }
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.consumed++;
+        pthread_cond_signal(&pipeline.not_full);
+        pthread_mutex_unlock(&pipeline.lock);
+    } while (size > 0);
+    pthread_join(reader, NULL);
+    free(pipeline.buffers);
+    free(pipeline.sizes);
+    *ok = size == 0;
+    return (true);
+}
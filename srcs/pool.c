@@ -0,0 +1,223 @@
+#include "ft_ssl.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Thread pool hashing of a file list (-j): every worker has its own context and a deque of files,
+ * a contiguous range of the list. Workers take files from the front of their range, and once it's
+ * empty they steal the back half of another worker's range. A huge file only holds up the worker
+ * hashing it, the files queued behind it are taken over by the others.
+ *
+ * Digests are stored per file and printed by the main thread, in the order of the list.
+*/
+
+typedef struct s_deque {
+    pthread_mutex_t lock;
+    i32 front;                          // Next file the owner takes
+    i32 back;                           // One past the last file of the range
+} t_deque;
+
+typedef struct s_worker {
+    pthread_t thread;
+    t_context ctx;                      // Hash context of the file being hashed
+    t_deque deque;                      // Files left to this worker
+    i32 id;                             // Index of the worker in the pool
+    bool started;                       // True if the thread has been created
+} t_worker;
+
+typedef struct s_pool_result {
+    byte digest[MAX_DIGEST_SIZE];       // The final hash value
+    u8 status;                          // FILE_* status of the file
+} t_pool_result;
+
+typedef struct s_pool {
+    t_worker *workers;
+    i32 jobs;                           // Number of workers
+    char **paths;                       // Paths of the files to hash
+    u8 alg;                             // FLAG_ALG_* of the context, to look files up in the cache
+    t_pool_result *results;             // One result per file
+    pthread_mutex_t done_lock;          // Protects the status of the results
+    pthread_cond_t done_cond;           // Signaled every time a file is done
+} t_pool;
+
+static t_pool _pool = {
+    .done_lock = PTHREAD_MUTEX_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief Takes the next file of a worker's own range
+ *
+ * @param worker Worker
+ * @param index Index of the file taken
+ * @return true A file was taken, false if the range is empty
+ */
+static bool _worker_take(t_worker *worker, i32 *index) {
+    bool taken = false;
+
+    pthread_mutex_lock(&worker->deque.lock);
+    if (worker->deque.front < worker->deque.back) {
+        *index = worker->deque.front++;
+        taken = true;
+    }
+    pthread_mutex_unlock(&worker->deque.lock);
+    return (taken);
+}
+
+/**
+ * @brief Steals the back half of the first non-empty range of another worker
+ *
+ * @param thief Worker whose range is empty
+ * @param index Index of the first stolen file, the others go in the thief's range
+ * @return true Files were stolen, false if every range is empty
+ */
+static bool _worker_steal(t_worker *thief, i32 *index) {
+    for (i32 i = 1; i < _pool.jobs; i++) {
+        t_worker *victim = &_pool.workers[(thief->id + i) % _pool.jobs];
+        i32 start, end;
+
+        pthread_mutex_lock(&victim->deque.lock);
+        end = victim->deque.back;
+        start = end - (end - victim->deque.front + 1) / 2;
+        if (start < end) {
+            victim->deque.back = start;
+        }
+        pthread_mutex_unlock(&victim->deque.lock);
+        if (start >= end) {
+            continue;
+        }
+        pthread_mutex_lock(&thief->deque.lock);
+        thief->deque.front = start + 1;
+        thief->deque.back = end;
+        pthread_mutex_unlock(&thief->deque.lock);
+        *index = start;
+        return (true);
+    }
+    return (false);
+}
+
+/**
+ * @brief Hashes a file of the list with the worker's context, stores the result
+ *
+ * @param worker Worker
+ * @param index Index of the file
+ */
+static void _worker_hash(t_worker *worker, i32 index) {
+    t_pool_result *result = &_pool.results[index];
+    u8 status = FILE_DONE;
+    t_cache_key key;
+    u64 start = STATS_START(), final;
+    i32 fd;
+
+    if (cache_lookup(_pool.paths[index], _pool.alg, result->digest, worker->ctx.digest_size, &key)) {
+        // unchanged since it was hashed, not even opened
+    } else if ((fd = open(_pool.paths[index], O_RDONLY)) == -1) {
+        status = FILE_NOT_FOUND;
+    } else {
+        STATS_COUNT(STATS_OPENS, 1);
+        STATS_STOP(STATS_READ, start);
+        worker->ctx.reset_fn(&worker->ctx);
+        if (ctx_chomp_fd(&worker->ctx, 1, fd)) {
+            final = STATS_START();
+            worker->ctx.final_fn(&worker->ctx);
+            STATS_STOP(STATS_FINAL, final);
+            ft_memcpy(result->digest, worker->ctx.digest, worker->ctx.digest_size);
+            cache_store(&key, fd, result->digest, worker->ctx.digest_size);
+        } else {
+            status = FILE_READ_FAILED;
+        }
+        close(fd);
+        if (stats_enabled && status == FILE_DONE) {
+            stats_file(_pool.paths[index], worker->ctx.chomped_bytes, start);
+        }
+    }
+    pthread_mutex_lock(&_pool.done_lock);
+    result->status = status;
+    pthread_cond_signal(&_pool.done_cond);
+    pthread_mutex_unlock(&_pool.done_lock);
+}
+
+static void *_worker_main(void *arg) {
+    t_worker *worker = arg;
+    i32 index;
+
+    while (_worker_take(worker, &index) || _worker_steal(worker, &index)) {
+        _worker_hash(worker, index);
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Hashes a list of files on several threads, prints digests in order
+ *
+ * @note The context is only used as a template for the workers and to print
+ *
+ * @param ctx Hash context
+ * @param paths Paths of the files to hash
+ * @param count Number of files
+ * @param flags Output flags
+ * @param jobs Number of threads
+ * @return true The files have been hashed, false if no thread could be started (nothing done)
+ */
+bool pool_hash_files(t_context *ctx, char **paths, i32 count, u8 flags, i32 jobs) {
+    i32 started = 0;
+
+    if (jobs > count) {
+        jobs = count;
+    }
+    _pool.jobs = jobs;
+    _pool.paths = paths;
+    _pool.alg = flags & (FLAG_ALG_MD5 | FLAG_ALG_SHA256);
+    _pool.results = malloc(count * sizeof(t_pool_result));
+    _pool.workers = malloc(jobs * sizeof(t_worker));
+    if (_pool.results == NULL || _pool.workers == NULL) {
+        free(_pool.results);
+        free(_pool.workers);
+        return (false);
+    }
+    for (i32 i = 0; i < count; i++) {
+        _pool.results[i].status = FILE_PENDING;
+    }
+    // every worker starts with an equal slice of the list, stealing balances the rest
+    for (i32 w = 0; w < jobs; w++) {
+        t_worker *worker = &_pool.workers[w];
+        pthread_mutex_init(&worker->deque.lock, NULL);
+        worker->deque.front = (i64) count * w / jobs;
+        worker->deque.back = (i64) count * (w + 1) / jobs;
+        worker->ctx = *ctx;
+        worker->id = w;
+    }
+    // the slice of a worker that couldn't be started is stolen by the others
+    for (i32 w = 0; w < jobs; w++) {
+        _pool.workers[w].started = pthread_create(&_pool.workers[w].thread, NULL, _worker_main, &_pool.workers[w]) == 0;
+        started += _pool.workers[w].started;
+    }
+
+    for (i32 i = 0; i < count && started > 0; i++) {
+        t_pool_result *result = &_pool.results[i];
+        pthread_mutex_lock(&_pool.done_lock);
+        while (result->status == FILE_PENDING) {
+            pthread_cond_wait(&_pool.done_cond, &_pool.done_lock);
+        }
+        pthread_mutex_unlock(&_pool.done_lock);
+        if (result->status == FILE_NOT_FOUND) {
+            print_error(ERR_FILE_NOT_FOUND, paths[i]);
+        } else if (result->status == FILE_READ_FAILED) {
+            print_error(ERR_FILE_READ_FAILED, paths[i]);
+        } else {
+            ft_memcpy(ctx->digest, result->digest, ctx->digest_size);
+            ctx_print_digest(ctx, paths[i], true, flags);
+        }
+    }
+
+    for (i32 w = 0; w < jobs; w++) {
+        if (_pool.workers[w].started) {
+            pthread_join(_pool.workers[w].thread, NULL);
+        }
+        pthread_mutex_destroy(&_pool.workers[w].deque.lock);
+    }
+    free(_pool.results);
+    free(_pool.workers);
+    return (started > 0);
+}
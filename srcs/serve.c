@@ -0,0 +1,643 @@
+#define _GNU_SOURCE // accept4
+// before ft_ssl.h: epoll_data has members named like the short types
+#include <sys/epoll.h>
+#include "ft_ssl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/**
+ * The serve command: a long-lived process answering hash requests on a Unix domain socket, so that
+ * a digest of a few bytes doesn't cost a fork and an exec. One thread, one epoll loop.
+ *
+ * A request is an 8-byte header: algorithm (SERVE_ALG_*), kind (SERVE_KIND_*), format (SERVE_FORMAT_*),
+ * a zero byte and the length of the payload (u32, little-endian), followed by the payload: the bytes
+ * to hash, or a path. A SERVE_KIND_FD request has no payload, the file descriptor to hash comes with
+ * its header (SCM_RIGHTS). The answer is a status byte (SERVE_*), the length of the digest and the
+ * digest, raw or in hex. Clients can send as many requests as they want without waiting, answers
+ * come in the same order.
+ *
+ * Every turn of the loop reads from every ready client, then hashes every complete request at once:
+ * inline payloads of the same algorithm share the lanes of the multi-buffer kernel, whichever
+ * client they come from. Paths and file descriptors are read and hashed in the loop itself, only
+ * regular files are accepted so that none of them can block it.
+*/
+
+#define SERVE_ALG_MD5       0
+#define SERVE_ALG_SHA256    1
+
+#define SERVE_KIND_DATA     0 // the payload is the message
+#define SERVE_KIND_PATH     1 // the payload is the path of a file
+#define SERVE_KIND_FD       2 // the file descriptor passed with the header
+
+#define SERVE_FORMAT_HEX    0
+#define SERVE_FORMAT_RAW    1
+
+#define SERVE_OK            FILE_DONE
+#define SERVE_NOT_FOUND     FILE_NOT_FOUND
+#define SERVE_READ_FAILED   FILE_READ_FAILED
+#define SERVE_BAD_REQUEST   4 // the connection is closed after this one
+
+#define SERVE_HEADER_SIZE   8
+#define SERVE_MAX_PAYLOAD   (1024 * 1024)
+#define SERVE_READ_SIZE     65536 // initial size of the input buffer of a client, grows up to a whole request
+#define SERVE_MAX_FDS       64 // file descriptors received but not hashed yet, per client
+#define SERVE_MAX_EVENTS    64
+
+typedef struct s_client {
+    i32 fd;                             // Connection
+    byte *in;                           // Bytes received, starting with a request
+    u32 in_size;
+    u32 in_capacity;
+    byte *out;                          // Answers not sent yet
+    u32 out_size;
+    u32 out_capacity;
+    i32 fds[SERVE_MAX_FDS];             // File descriptors received, in order
+    u32 fds_head;
+    u32 fds_count;
+    bool closing;                       // End of stream or bad request: no more reads, closed once the answers are sent
+} t_client;
+
+typedef struct s_request {
+    t_client *client;
+    u8 alg;                             // SERVE_ALG_*
+    u8 kind;                            // SERVE_KIND_*
+    u8 format;                          // SERVE_FORMAT_*
+    u8 status;                          // SERVE_*, set once hashed
+    const byte *payload;                // Inside the input buffer of the client
+    u32 size;
+    i32 fd;                             // File descriptor of a SERVE_KIND_FD request
+    t_context ctx;                      // Holds the digest once hashed
+} t_request;
+
+typedef struct s_serve {
+    i32 listen_fd;
+    i32 epoll_fd;
+    t_context templates[2];             // Initialized once, copied for every request
+    t_client **clients;                 // Indexed by connection fd
+    i32 clients_size;
+    t_request *requests;                // Complete requests of the current turn
+    u32 requests_count;
+    u32 requests_capacity;
+} t_serve;
+
+static volatile sig_atomic_t _serve_stop = 0;
+
+static void _serve_signal(int sig) {
+    (void) sig;
+    _serve_stop = 1;
+}
+
+/**
+ * @brief Makes sure a buffer can hold size bytes
+ *
+ * @return true Success, false if the allocation failed
+ */
+static bool _serve_reserve(byte **buffer, u32 *capacity, u32 size) {
+    u32 new_capacity = *capacity > 0 ? *capacity : 256;
+    byte *grown;
+
+    if (size <= *capacity) {
+        return (true);
+    }
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+    grown = realloc(*buffer, new_capacity);
+    if (grown == NULL) {
+        return (false);
+    }
+    *buffer = grown;
+    *capacity = new_capacity;
+    return (true);
+}
+
+/**
+ * @brief Watches a client for reads, or for writes while answers are waiting to be sent
+ */
+static void _serve_watch(t_serve *serve, t_client *client, i32 op) {
+    struct epoll_event event = {0};
+
+    event.events = client->out_size > 0 ? EPOLLOUT : (client->closing ? 0 : EPOLLIN);
+    event.data.fd = client->fd;
+    epoll_ctl(serve->epoll_fd, op, client->fd, &event);
+}
+
+static void _serve_close(t_serve *serve, t_client *client) {
+    epoll_ctl(serve->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    for (; client->fds_count > 0; client->fds_count--) {
+        close(client->fds[client->fds_head++ % SERVE_MAX_FDS]);
+    }
+    serve->clients[client->fd] = NULL;
+    free(client->in);
+    free(client->out);
+    free(client);
+}
+
+/**
+ * @brief Accepts every pending connection
+ */
+static void _serve_accept(t_serve *serve) {
+    i32 fd;
+
+    while ((fd = accept4(serve->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        if (fd >= serve->clients_size) {
+            i32 size = serve->clients_size * 2 > fd ? serve->clients_size * 2 : fd + 1;
+            t_client **grown = realloc(serve->clients, size * sizeof(t_client *));
+            if (grown == NULL) {
+                close(fd);
+                continue;
+            }
+            ft_memset(grown + serve->clients_size, 0, (size - serve->clients_size) * sizeof(t_client *));
+            serve->clients = grown;
+            serve->clients_size = size;
+        }
+        t_client *client = calloc(1, sizeof(t_client));
+        if (client == NULL || !_serve_reserve(&client->in, &client->in_capacity, SERVE_READ_SIZE)) {
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        serve->clients[fd] = client;
+        _serve_watch(serve, client, EPOLL_CTL_ADD);
+    }
+}
+
+/**
+ * @brief Receives what a client sent, and the file descriptors that came with it
+ *
+ * @note Stops once the buffer is full of complete requests, the rest is read at the next turn
+ */
+static void _serve_receive(t_client *client) {
+    byte control[CMSG_SPACE(sizeof(i32) * SERVE_MAX_FDS)];
+    struct msghdr msg = {0};
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    i64 received;
+
+    while (!client->closing) {
+        if (client->in_size == client->in_capacity) {
+            // a request larger than the buffer needs more room, complete ones are served first
+            u32 needed = client->in_size >= SERVE_HEADER_SIZE ? SERVE_HEADER_SIZE + to_u32(client->in + 4) : 0;
+            if (needed <= client->in_capacity || needed > SERVE_HEADER_SIZE + SERVE_MAX_PAYLOAD
+                || !_serve_reserve(&client->in, &client->in_capacity, needed)) {
+                return ;
+            }
+        }
+        iov.iov_base = client->in + client->in_size;
+        iov.iov_len = client->in_capacity - client->in_size;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        received = recvmsg(client->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (received == -1 && errno == EINTR) {
+            continue;
+        } else if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return ;
+        } else if (received <= 0) {
+            client->closing = true;
+            return ;
+        }
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            u32 count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(i32);
+            for (u32 i = 0; i < count; i++) {
+                i32 fd;
+                ft_memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(i32), sizeof(i32));
+                if (client->fds_count == SERVE_MAX_FDS) {
+                    close(fd);
+                    continue;
+                }
+                client->fds[(client->fds_head + client->fds_count++) % SERVE_MAX_FDS] = fd;
+            }
+        }
+        client->in_size += received;
+    }
+}
+
+/**
+ * @brief Adds a request to the current turn
+ *
+ * @return t_request* The request, NULL if the allocation failed
+ */
+static t_request *_serve_push(t_serve *serve, t_client *client) {
+    if (serve->requests_count == serve->requests_capacity) {
+        u32 capacity = serve->requests_capacity > 0 ? serve->requests_capacity * 2 : 256;
+        t_request *grown = realloc(serve->requests, capacity * sizeof(t_request));
+        if (grown == NULL) {
+            return (NULL);
+        }
+        serve->requests = grown;
+        serve->requests_capacity = capacity;
+    }
+    t_request *request = &serve->requests[serve->requests_count++];
+    request->client = client;
+    request->fd = -1;
+    request->format = SERVE_FORMAT_HEX;
+    request->status = SERVE_BAD_REQUEST;
+    return (request);
+}
+
+/**
+ * @brief Turns the complete requests of a client's buffer into requests of the current turn
+ *
+ * @return u32 Number of bytes used, the incomplete request that may follow stays in the buffer
+ */
+static u32 _serve_parse(t_serve *serve, t_client *client) {
+    u32 offset = 0;
+
+    while (client->in_size - offset >= SERVE_HEADER_SIZE) {
+        const byte *header = client->in + offset;
+        u32 size = to_u32(header + 4);
+        bool valid = header[0] <= SERVE_ALG_SHA256 && header[1] <= SERVE_KIND_FD
+            && header[2] <= SERVE_FORMAT_RAW && header[3] == 0 && size <= SERVE_MAX_PAYLOAD
+            && (header[1] != SERVE_KIND_FD || (size == 0 && client->fds_count > 0))
+            && (header[1] != SERVE_KIND_PATH || (size > 0 && size < PATH_MAX));
+        if (valid && client->in_size - offset - SERVE_HEADER_SIZE < size) {
+            break;
+        }
+        t_request *request = _serve_push(serve, client);
+        if (request == NULL || !valid) {
+            // the stream can't be trusted past a bad header
+            client->closing = true;
+            return (client->in_size);
+        }
+        request->alg = header[0];
+        request->kind = header[1];
+        request->format = header[2];
+        request->payload = header + SERVE_HEADER_SIZE;
+        request->size = size;
+        request->status = FILE_PENDING;
+        request->ctx = serve->templates[request->alg];
+        if (request->kind == SERVE_KIND_FD) {
+            request->fd = client->fds[client->fds_head++ % SERVE_MAX_FDS];
+            client->fds_count--;
+        }
+        offset += SERVE_HEADER_SIZE + size;
+    }
+    return (offset);
+}
+
+/**
+ * @brief Hashes a file by path or by file descriptor
+ *
+ * @note Only regular files: a FIFO, a pipe or a device could block the loop, and every client with it.
+ * Opening a FIFO doesn't wait for a writer with O_NONBLOCK.
+ */
+static void _serve_hash_file(t_request *request) {
+    char path[PATH_MAX];
+    i32 fd = request->fd;
+    struct stat st;
+
+    if (request->kind == SERVE_KIND_PATH) {
+        ft_memcpy(path, request->payload, request->size);
+        path[request->size] = '\0';
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            request->status = SERVE_NOT_FOUND;
+            return ;
+        }
+    }
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        request->status = SERVE_READ_FAILED;
+        close(fd);
+        return ;
+    }
+    request->status = ctx_chomp_fd(&request->ctx, 1, fd) ? SERVE_OK : SERVE_READ_FAILED;
+    if (request->status == SERVE_OK) {
+        request->ctx.final_fn(&request->ctx);
+    }
+    close(fd);
+}
+
+/**
+ * @brief Gives the next inline request of an algorithm to a lane
+ *
+ * @note The whole blocks are compressed straight from the client's buffer, then the padded
+ * last block(s) from the context's buffer
+ *
+ * @param lane Where the lane's request is stored
+ * @param data Next block of the lane
+ * @param nblocks Number of blocks left in data
+ * @return true A request was given, false if there are none left
+ */
+static bool _serve_lane_start(t_serve *serve, u32 *next, u8 alg, t_request **lane, const byte **data, u64 *nblocks) {
+    for (; *next < serve->requests_count; (*next)++) {
+        t_request *request = &serve->requests[*next];
+        if (request->status != FILE_PENDING || request->kind != SERVE_KIND_DATA || request->alg != alg) {
+            continue;
+        }
+        t_context *ctx = &request->ctx;
+        u32 tail = request->size % BLOCK_SIZE;
+        ft_memcpy(ctx->buffer, request->payload + request->size - tail, tail);
+        ctx->buffer_size = tail;
+        ctx->chomped_bytes = request->size;
+        ctx->pad_fn(ctx);
+        *lane = request;
+        *data = request->payload;
+        *nblocks = request->size / BLOCK_SIZE;
+        if (*nblocks == 0) {
+            *data = ctx->buffer;
+            *nblocks = ctx->buffer_size / BLOCK_SIZE;
+        }
+        (*next)++;
+        return (true);
+    }
+    return (false);
+}
+
+/**
+ * @brief Hashes the inline requests of an algorithm side by side in the lanes of the multi-buffer kernel
+ *
+ * @note Each round compresses as many blocks as the shortest lane has left, a lane that is done
+ * takes the next request
+ */
+static void _serve_hash_lanes(t_serve *serve, u8 alg, const t_mb_kernel *kernel) {
+    t_request *lanes[MB_MAX_LANES] = {0};
+    const byte *data[MB_MAX_LANES] = {0};
+    byte *digests[MB_MAX_LANES] = {0};
+    u64 nblocks[MB_MAX_LANES] = {0};
+    u32 next = 0;
+    u8 busy = 0;
+
+    for (u8 l = 0; l < kernel->lanes; l++) {
+        if (_serve_lane_start(serve, &next, alg, &lanes[l], &data[l], &nblocks[l])) {
+            digests[l] = lanes[l]->ctx.digest;
+            busy++;
+        }
+    }
+    while (busy > 0) {
+        u64 round = (u64) -1;
+        for (u8 l = 0; l < kernel->lanes; l++) {
+            if (lanes[l] != NULL && nblocks[l] < round) {
+                round = nblocks[l];
+            }
+        }
+        kernel->digest_fn(digests, data, round);
+        for (u8 l = 0; l < kernel->lanes; l++) {
+            if (lanes[l] == NULL) {
+                continue;
+            }
+            data[l] += round * BLOCK_SIZE;
+            nblocks[l] -= round;
+            t_context *ctx = &lanes[l]->ctx;
+            if (nblocks[l] > 0) {
+                continue;
+            } else if (data[l] != ctx->buffer + ctx->buffer_size) {
+                // the whole blocks are done, the padding is left
+                data[l] = ctx->buffer;
+                nblocks[l] = ctx->buffer_size / BLOCK_SIZE;
+                continue;
+            }
+            if (ctx->output_fn != NULL) {
+                ctx->output_fn(ctx);
+            }
+            lanes[l]->status = SERVE_OK;
+            lanes[l] = NULL;
+            data[l] = NULL;
+            digests[l] = NULL;
+            busy--;
+            if (_serve_lane_start(serve, &next, alg, &lanes[l], &data[l], &nblocks[l])) {
+                digests[l] = lanes[l]->ctx.digest;
+                busy++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Hashes every request of the current turn
+ */
+static void _serve_hash(t_serve *serve) {
+    u32 inline_count[2] = {0};
+
+    for (u32 i = 0; i < serve->requests_count; i++) {
+        t_request *request = &serve->requests[i];
+        if (request->status != FILE_PENDING) {
+            continue;
+        } else if (request->kind != SERVE_KIND_DATA) {
+            _serve_hash_file(request);
+        } else {
+            inline_count[request->alg]++;
+        }
+    }
+    for (u8 alg = SERVE_ALG_MD5; alg <= SERVE_ALG_SHA256; alg++) {
+        const t_mb_kernel *kernel = serve->templates[alg].mb_kernel;
+        if (kernel != NULL && !MB_FEW_LANES(inline_count[alg], kernel->lanes)) {
+            _serve_hash_lanes(serve, alg, kernel);
+            continue;
+        }
+        for (u32 i = 0; i < serve->requests_count && inline_count[alg] > 0; i++) {
+            t_request *request = &serve->requests[i];
+            if (request->status == FILE_PENDING && request->kind == SERVE_KIND_DATA && request->alg == alg) {
+                ctx_chomp(&request->ctx, request->payload, request->size);
+                request->ctx.final_fn(&request->ctx);
+                request->status = SERVE_OK;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Appends the answer of a request to its client's output buffer
+ */
+static void _serve_answer(t_request *request) {
+    t_client *client = request->client;
+    u8 size = request->status != SERVE_OK ? 0 : request->ctx.digest_size;
+    u8 length = request->format == SERVE_FORMAT_HEX ? size * 2 : size;
+
+    if (!_serve_reserve(&client->out, &client->out_capacity, client->out_size + 2 + length)) {
+        client->closing = true;
+        return ;
+    }
+    client->out[client->out_size] = request->status;
+    client->out[client->out_size + 1] = length;
+    if (request->format == SERVE_FORMAT_HEX) {
+        hex_encode(request->ctx.digest, (char *) client->out + client->out_size + 2, size);
+    } else {
+        ft_memcpy(client->out + client->out_size + 2, request->ctx.digest, size);
+    }
+    client->out_size += 2 + length;
+}
+
+/**
+ * @brief Sends as much of a client's answers as the socket takes
+ *
+ * @return false The connection is broken
+ */
+static bool _serve_send(t_client *client) {
+    u32 sent_total = 0;
+
+    while (sent_total < client->out_size) {
+        i64 sent = send(client->fd, client->out + sent_total, client->out_size - sent_total, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        } else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (sent <= 0) {
+            return (false);
+        }
+        sent_total += sent;
+    }
+    ft_memcpy(client->out, client->out + sent_total, client->out_size - sent_total);
+    client->out_size -= sent_total;
+    return (true);
+}
+
+/**
+ * @brief Sends the answers of a client, closes it when it's done with
+ */
+static void _serve_flush(t_serve *serve, t_client *client) {
+    if (!_serve_send(client) || (client->closing && client->out_size == 0)) {
+        _serve_close(serve, client);
+        return ;
+    }
+    _serve_watch(serve, client, EPOLL_CTL_MOD);
+}
+
+/**
+ * @brief One turn of the loop: reads every ready client, hashes every complete request, answers them
+ *
+ * @param events Ready file descriptors
+ * @param count Number of events
+ */
+static void _serve_turn(t_serve *serve, struct epoll_event *events, i32 count) {
+    u32 used[SERVE_MAX_EVENTS];
+
+    serve->requests_count = 0;
+    for (i32 i = 0; i < count; i++) {
+        t_client *client = serve->clients[events[i].data.fd];
+        // a hang up or an error is read as the end of the stream
+        if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 && !client->closing) {
+            _serve_receive(client);
+        }
+    }
+    for (i32 i = 0; i < count; i++) {
+        t_client *client = serve->clients[events[i].data.fd];
+        used[i] = _serve_parse(serve, client);
+    }
+    _serve_hash(serve);
+    for (u32 i = 0; i < serve->requests_count; i++) {
+        _serve_answer(&serve->requests[i]);
+    }
+    for (i32 i = 0; i < count; i++) {
+        t_client *client = serve->clients[events[i].data.fd];
+        // the incomplete request goes back to the front of the buffer
+        client->in_size -= used[i];
+        ft_memcpy(client->in, client->in + used[i], client->in_size);
+        _serve_flush(serve, client);
+    }
+}
+
+/**
+ * @brief Binds the listening socket, replaces a stale socket left by a server that died
+ *
+ * @return i32 Listening socket, -1 on error
+ */
+static i32 _serve_listen(char *path) {
+    struct sockaddr_un addr = {0};
+    struct stat st;
+    i32 fd, probe;
+    bool stale;
+
+    if (ft_strlen(path) >= (i32) sizeof(addr.sun_path)) {
+        return (-1);
+    }
+    addr.sun_family = AF_UNIX;
+    ft_memcpy(addr.sun_path, path, ft_strlen(path));
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return (-1);
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        // a socket nobody answers on is what's left of a server that died
+        probe = errno == EADDRINUSE && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) ? socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+        stale = probe != -1 && connect(probe, (struct sockaddr *) &addr, sizeof(addr)) == -1 && errno == ECONNREFUSED;
+        if (probe != -1) {
+            close(probe);
+        }
+        if (!stale || unlink(path) == -1 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+            close(fd);
+            return (-1);
+        }
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        unlink(path);
+        return (-1);
+    }
+    return (fd);
+}
+
+/**
+ * @brief The serve command: ft_ssl serve --socket PATH, runs until SIGINT or SIGTERM
+ *
+ * @param argc Number of arguments
+ * @param argv All passed arguments, --socket comes after argv[1]
+ * @return int Exit code
+ */
+int serve_command(int argc, char **argv) {
+    t_serve serve = {.templates = {md5_init(0), sha256_init(0)}};
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    struct epoll_event event = {0};
+    struct sigaction action = {0};
+    i32 count;
+
+    if (argc != 4 || ft_strcmp(argv[2], "--socket") != 0 || argv[3][0] == '\0') {
+        print_error(ERR_INVALID_FLAG, "usage: serve --socket PATH");
+        return (1);
+    }
+    serve.listen_fd = _serve_listen(argv[3]);
+    if (serve.listen_fd == -1) {
+        print_error(ERR_SOCKET_FAILED, argv[3]);
+        return (1);
+    }
+    serve.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event.events = EPOLLIN;
+    event.data.fd = serve.listen_fd;
+    if (serve.epoll_fd == -1 || epoll_ctl(serve.epoll_fd, EPOLL_CTL_ADD, serve.listen_fd, &event) == -1) {
+        print_error(ERR_SOCKET_FAILED, argv[3]);
+        close(serve.listen_fd);
+        unlink(argv[3]);
+        return (1);
+    }
+    // no SA_RESTART: epoll_wait has to return to see the flag
+    action.sa_handler = _serve_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    while (!_serve_stop) {
+        count = epoll_wait(serve.epoll_fd, events, SERVE_MAX_EVENTS, -1);
+        if (count == -1 && errno != EINTR) {
+            break;
+        }
+        // the listening socket is left out of the turn, clients are all that's left
+        for (i32 i = 0; i < count; i++) {
+            if (events[i].data.fd == serve.listen_fd) {
+                _serve_accept(&serve);
+                events[i--] = events[--count];
+            }
+        }
+        _serve_turn(&serve, events, count);
+    }
+    for (i32 fd = 0; fd < serve.clients_size; fd++) {
+        if (serve.clients[fd] != NULL) {
+            _serve_close(&serve, serve.clients[fd]);
+        }
+    }
+    free(serve.clients);
+    free(serve.requests);
+    close(serve.epoll_fd);
+    close(serve.listen_fd);
+    unlink(argv[3]);
+    return (0);
+}
@@ -2,7 +2,7 @@
 
 // https://en.wikipedia.org/wiki/SHA-2
 
-static const u32 _sha256_initial_digest[SHA256_DIGEST_SIZE / 4] = {
+const u32 sha256_initial_digest[SHA256_DIGEST_SIZE / 4] = {
     0x6a09e667,
 	0xbb67ae85,
 	0x3c6ef372,
@@ -13,7 +13,7 @@ static const u32 _sha256_initial_digest[SHA256_DIGEST_SIZE / 4] = {
 	0x5be0cd19,
 };
 
-static const u32 k[64] = {
+const u32 sha256_k[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
     0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
     0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
@@ -25,34 +25,34 @@ static const u32 k[64] = {
 };
 
 /**
- * @brief Eats BUFFER_SIZE bytes from the buffer and updates the hash context
+ * @brief Compresses whole 64-byte blocks into the intermediate hash value
  * 
- * @param ctx Hash context
- * @param buf A sentinel-terminated buffer
- * @param n Number of bytes to eat (if > BUFFER_SIZE, the rest is dropped)
+ * @note Compact version, kept as a reference for sha256_digest_unrolled
+ * 
+ * @param digest Intermediate hash value (8 little endian 32-bit words)
+ * @param blocks Message blocks, read in place
+ * @param nblocks Number of 64-byte blocks to compress
  */
-void sha256_digest(t_context *ctx) {
+void sha256_digest(byte *digest, const byte *blocks, u64 nblocks) {
     // process 512-bit chunks (512 / 8 = 64)
     u32 words[64];
     u32 h0, h1, h2, h3, h4, h5, h6, h7, s0, s1, ch, maj, temp1, temp2, a, b, c, d, e, f, g, h;
 
     // digest is a unsigned char array, h0..7 are 32-bit integers
     // for each var, fetch 4 bytes from the digest and convert them to a 32-bit integer
-    h0 = to_u32(ctx->digest);
-    h1 = to_u32(ctx->digest + 4);
-    h2 = to_u32(ctx->digest + 8);
-    h3 = to_u32(ctx->digest + 12);
-    h4 = to_u32(ctx->digest + 16);
-    h5 = to_u32(ctx->digest + 20);
-    h6 = to_u32(ctx->digest + 24);
-    h7 = to_u32(ctx->digest + 28);
-
-    for (u32 offset = 0; offset < ctx->buffer_size; offset += 64) {
-        for (i32 i = 0; i < 64; i++) {
-        }
+    h0 = to_u32(digest);
+    h1 = to_u32(digest + 4);
+    h2 = to_u32(digest + 8);
+    h3 = to_u32(digest + 12);
+    h4 = to_u32(digest + 16);
+    h5 = to_u32(digest + 20);
+    h6 = to_u32(digest + 24);
+    h7 = to_u32(digest + 28);
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
         // break into 16 32-bit words
         for (i32 i = 0; i < 16; i++) {
-            words[i] = to_u32(ctx->buffer + offset + i * 4);
+            words[i] = to_u32(blocks + i * 4);
             // swap endianness (little to big endian)
             words[i] = (words[i] >> 24) | ((words[i] >> 8) & 0xFF00) | ((words[i] << 8) & 0xFF0000) | (words[i] << 24);
         }
@@ -78,7 +78,7 @@ void sha256_digest(t_context *ctx) {
         for (i32 i = 0; i < 64; i++) {
             s1 = RIGHTROTATE(e, 6) ^ RIGHTROTATE(e, 11) ^ RIGHTROTATE(e, 25);
             ch = (e & f) ^ ((~e) & g);
-            temp1 = h + s1 + ch + k[i] + words[i];
+            temp1 = h + s1 + ch + sha256_k[i] + words[i];
             s0 = RIGHTROTATE(a, 2) ^ RIGHTROTATE(a, 13) ^ RIGHTROTATE(a, 22);
             maj = (a & b) ^ (a & c) ^ (b & c);
             temp2 = s0 + maj;
@@ -105,18 +105,177 @@ void sha256_digest(t_context *ctx) {
 
     }
     // store the result in the digest
-    to_bytes(h0, ctx->digest);
-    to_bytes(h1, ctx->digest + 4);
-    to_bytes(h2, ctx->digest + 8);
-    to_bytes(h3, ctx->digest + 12);
-    to_bytes(h4, ctx->digest + 16);
-    to_bytes(h5, ctx->digest + 20);
-    to_bytes(h6, ctx->digest + 24);
-    to_bytes(h7, ctx->digest + 28);
+    to_bytes(h0, digest);
+    to_bytes(h1, digest + 4);
+    to_bytes(h2, digest + 8);
+    to_bytes(h3, digest + 12);
+    to_bytes(h4, digest + 16);
+    to_bytes(h5, digest + 20);
+    to_bytes(h6, digest + 24);
+    to_bytes(h7, digest + 28);
 }
 
+// Round functions, Ch and Maj rewritten with less operations than their textbook form
+#define SHA256_CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA256_BSIG0(x) (RIGHTROTATE(x, 2) ^ RIGHTROTATE(x, 13) ^ RIGHTROTATE(x, 22))
+#define SHA256_BSIG1(x) (RIGHTROTATE(x, 6) ^ RIGHTROTATE(x, 11) ^ RIGHTROTATE(x, 25))
+#define SHA256_SSIG0(x) (RIGHTROTATE(x, 7) ^ RIGHTROTATE(x, 18) ^ ((x) >> 3))
+#define SHA256_SSIG1(x) (RIGHTROTATE(x, 17) ^ RIGHTROTATE(x, 19) ^ ((x) >> 10))
+
+// Word i of the schedule, computed in place in a 16-word ring (w[i & 15] holds word i - 16 before)
+#define SHA256_SCHEDULE(i) \
+    (w[(i) & 15] += SHA256_SSIG1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + SHA256_SSIG0(w[((i) - 15) & 15]))
+
+// One round, the caller rotates the variable names instead of shifting their values
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, word, constant) \
+    t1 = h + SHA256_BSIG1(e) + SHA256_CH(e, f, g) + (constant) + (word); \
+    d += t1; \
+    h = t1 + SHA256_BSIG0(a) + SHA256_MAJ(a, b, c);
+
 /**
- * @brief Finalize the SHA-256 hash function, runs post-processing steps
+ * @brief Same as sha256_digest, with the 64 rounds written out
+ * 
+ * @note Constants are inlined and the message schedule lives in a 16-word ring computed on the fly,
+ * instead of a full 64-word array built before the rounds
+ * 
+ * @param digest Intermediate hash value (8 little endian 32-bit words)
+ * @param blocks Message blocks, read in place
+ * @param nblocks Number of 64-byte blocks to compress
+ */
+void sha256_digest_unrolled(byte *digest, const byte *blocks, u64 nblocks) {
+    u32 w[16];
+    u32 a, b, c, d, e, f, g, h, t1;
+    u32 h0 = LOAD_LE32(digest);
+    u32 h1 = LOAD_LE32(digest + 4);
+    u32 h2 = LOAD_LE32(digest + 8);
+    u32 h3 = LOAD_LE32(digest + 12);
+    u32 h4 = LOAD_LE32(digest + 16);
+    u32 h5 = LOAD_LE32(digest + 20);
+    u32 h6 = LOAD_LE32(digest + 24);
+    u32 h7 = LOAD_LE32(digest + 28);
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        for (i32 i = 0; i < 16; i++) {
+            w[i] = LOAD_BE32(blocks + i * 4);
+        }
+        a = h0;
+        b = h1;
+        c = h2;
+        d = h3;
+        e = h4;
+        f = h5;
+        g = h6;
+        h = h7;
+
+        // rounds 0-15 use the message words as they are
+        SHA256_ROUND(a, b, c, d, e, f, g, h, w[ 0], 0x428a2f98);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, w[ 1], 0x71374491);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, w[ 2], 0xb5c0fbcf);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, w[ 3], 0xe9b5dba5);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, w[ 4], 0x3956c25b);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, w[ 5], 0x59f111f1);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, w[ 6], 0x923f82a4);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, w[ 7], 0xab1c5ed5);
+        SHA256_ROUND(a, b, c, d, e, f, g, h, w[ 8], 0xd807aa98);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, w[ 9], 0x12835b01);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, w[10], 0x243185be);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, w[11], 0x550c7dc3);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, w[12], 0x72be5d74);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, w[13], 0x80deb1fe);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, w[14], 0x9bdc06a7);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, w[15], 0xc19bf174);
+
+        // rounds 16-63 extend the schedule as they go
+        SHA256_ROUND(a, b, c, d, e, f, g, h, SHA256_SCHEDULE(16), 0xe49b69c1);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, SHA256_SCHEDULE(17), 0xefbe4786);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, SHA256_SCHEDULE(18), 0x0fc19dc6);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, SHA256_SCHEDULE(19), 0x240ca1cc);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, SHA256_SCHEDULE(20), 0x2de92c6f);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, SHA256_SCHEDULE(21), 0x4a7484aa);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, SHA256_SCHEDULE(22), 0x5cb0a9dc);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, SHA256_SCHEDULE(23), 0x76f988da);
+        SHA256_ROUND(a, b, c, d, e, f, g, h, SHA256_SCHEDULE(24), 0x983e5152);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, SHA256_SCHEDULE(25), 0xa831c66d);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, SHA256_SCHEDULE(26), 0xb00327c8);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, SHA256_SCHEDULE(27), 0xbf597fc7);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, SHA256_SCHEDULE(28), 0xc6e00bf3);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, SHA256_SCHEDULE(29), 0xd5a79147);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, SHA256_SCHEDULE(30), 0x06ca6351);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, SHA256_SCHEDULE(31), 0x14292967);
+        SHA256_ROUND(a, b, c, d, e, f, g, h, SHA256_SCHEDULE(32), 0x27b70a85);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, SHA256_SCHEDULE(33), 0x2e1b2138);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, SHA256_SCHEDULE(34), 0x4d2c6dfc);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, SHA256_SCHEDULE(35), 0x53380d13);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, SHA256_SCHEDULE(36), 0x650a7354);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, SHA256_SCHEDULE(37), 0x766a0abb);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, SHA256_SCHEDULE(38), 0x81c2c92e);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, SHA256_SCHEDULE(39), 0x92722c85);
+        SHA256_ROUND(a, b, c, d, e, f, g, h, SHA256_SCHEDULE(40), 0xa2bfe8a1);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, SHA256_SCHEDULE(41), 0xa81a664b);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, SHA256_SCHEDULE(42), 0xc24b8b70);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, SHA256_SCHEDULE(43), 0xc76c51a3);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, SHA256_SCHEDULE(44), 0xd192e819);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, SHA256_SCHEDULE(45), 0xd6990624);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, SHA256_SCHEDULE(46), 0xf40e3585);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, SHA256_SCHEDULE(47), 0x106aa070);
+        SHA256_ROUND(a, b, c, d, e, f, g, h, SHA256_SCHEDULE(48), 0x19a4c116);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, SHA256_SCHEDULE(49), 0x1e376c08);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, SHA256_SCHEDULE(50), 0x2748774c);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, SHA256_SCHEDULE(51), 0x34b0bcb5);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, SHA256_SCHEDULE(52), 0x391c0cb3);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, SHA256_SCHEDULE(53), 0x4ed8aa4a);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, SHA256_SCHEDULE(54), 0x5b9cca4f);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, SHA256_SCHEDULE(55), 0x682e6ff3);
+        SHA256_ROUND(a, b, c, d, e, f, g, h, SHA256_SCHEDULE(56), 0x748f82ee);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, SHA256_SCHEDULE(57), 0x78a5636f);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, SHA256_SCHEDULE(58), 0x84c87814);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, SHA256_SCHEDULE(59), 0x8cc70208);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, SHA256_SCHEDULE(60), 0x90befffa);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, SHA256_SCHEDULE(61), 0xa4506ceb);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, SHA256_SCHEDULE(62), 0xbef9a3f7);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, SHA256_SCHEDULE(63), 0xc67178f2);
+
+        h0 += a;
+        h1 += b;
+        h2 += c;
+        h3 += d;
+        h4 += e;
+        h5 += f;
+        h6 += g;
+        h7 += h;
+    }
+    to_bytes(h0, digest);
+    to_bytes(h1, digest + 4);
+    to_bytes(h2, digest + 8);
+    to_bytes(h3, digest + 12);
+    to_bytes(h4, digest + 16);
+    to_bytes(h5, digest + 20);
+    to_bytes(h6, digest + 24);
+    to_bytes(h7, digest + 28);
+}
+
+// Digest implementations, fastest first
+static const t_kernel _sha256_kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"sha-ni", CPU_SHA | CPU_SSE41, sha256_ni_digest},
+#endif
+    {"unrolled", 0, sha256_digest_unrolled},
+    {"scalar", 0, sha256_digest},
+    {NULL, 0, NULL}
+};
+
+/**
+ * @brief Returns every SHA-256 digest implementation, fastest first
+ * 
+ * @return const t_kernel* NULL-terminated kernel table
+ */
+const t_kernel *sha256_kernels(void) {
+    return (_sha256_kernels);
+}
+
+/**
+ * @brief Pads the message in the internal buffer, without digesting it
  * 
  * @note SHA-256 post-processing steps:
  * - Append a single '1' bit to the message
@@ -125,7 +284,7 @@ void sha256_digest(t_context *ctx) {
  * 
  * @param ctx Hash context
  */
-void sha256_final(t_context *ctx) {
+void sha256_pad(t_context *ctx) {
     // append 1-bit
     u64 bits = (ctx->chomped_bytes) * 8;
     ctx->buffer[ctx->buffer_size++] = 0b10000000;
@@ -139,14 +298,30 @@ void sha256_final(t_context *ctx) {
     for (int i = 0; i < 8; i++) {
         ctx->buffer[ctx->buffer_size++] = (bits >> (56 - i * 8)) & 0xFF;
     }
-    ctx->digest_fn(ctx);
+}
 
+/**
+ * @brief Turns the last intermediate hash value into the digest
+ * 
+ * @param ctx Hash context
+ */
+void sha256_output(t_context *ctx) {
     // swap endianness of digest
     for (i32 i = 0; i < 8; i++) {
         u32 tmp = to_u32(ctx->digest + i * 4);
         to_bytes((tmp >> 24) | ((tmp >> 8) & 0xFF00) | ((tmp << 8) & 0xFF0000) | (tmp << 24), ctx->digest + i * 4);
     }
+}
 
+/**
+ * @brief Finalize the SHA-256 hash function, runs post-processing steps
+ * 
+ * @param ctx Hash context
+ */
+void sha256_final(t_context *ctx) {
+    sha256_pad(ctx);
+    ctx->digest_fn(ctx->digest, ctx->buffer, ctx->buffer_size / SHA256_BLOCK_SIZE);
+    sha256_output(ctx);
 }
 
 
@@ -159,7 +334,7 @@ void sha256_reset(t_context *ctx) {
     ctx->chomped_bytes = 0;
     ctx->stream_finished = false;
     ctx->buffer_size = 0;
-    ft_memcpy(ctx->digest, _sha256_initial_digest, SHA256_DIGEST_SIZE);
+    ft_memcpy(ctx->digest, sha256_initial_digest, SHA256_DIGEST_SIZE);
 }
 
 /**
@@ -167,6 +342,7 @@ void sha256_reset(t_context *ctx) {
  * 
  * @note Initialize the digest to :
  * 0x6a09e667bb67ae853c6ef372a54ff53a510e527f9b05688c1f83d9ab5be0cd19
+ * The digest function is the fastest one the CPU supports (see _sha256_kernels)
  * 
  * @param known_size Size of the message to hash, 0 if unknown
  * 
@@ -175,14 +351,17 @@ void sha256_reset(t_context *ctx) {
 t_context sha256_init(u64 known_size) {
     t_context new_ctx;
     new_ctx.chomped_bytes = 0;
-    new_ctx.digest_fn = sha256_digest;
+    new_ctx.digest_fn = kernel_select(_sha256_kernels)->digest_fn;
     new_ctx.final_fn = sha256_final;
     new_ctx.reset_fn = sha256_reset;
+    new_ctx.pad_fn = sha256_pad;
+    new_ctx.output_fn = sha256_output;
+    new_ctx.mb_kernel = sha256_mb_kernel();
     new_ctx.digest_size = SHA256_DIGEST_SIZE;
     new_ctx.buffer_size = 0;
     new_ctx.stream_finished = false;
     new_ctx.alg_name = SHA256_ALG_NAME;
     new_ctx.known_size = known_size;
-    ft_memcpy(new_ctx.digest, _sha256_initial_digest, SHA256_DIGEST_SIZE);
+    ft_memcpy(new_ctx.digest, sha256_initial_digest, SHA256_DIGEST_SIZE);
     return new_ctx;
 }
@@ -0,0 +1,57 @@
+#include "ft_ssl.h"
+
+// Multi-buffer SHA-256, hashes several independent messages at once (one per SIMD lane)
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define MB_LANES 8
+#define MB_TARGET "avx2"
+#define MB_NAME sha256_x8_avx2
+#include "sha256_mb_kernel.h"
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_NAME
+
+#define MB_LANES 16
+#define MB_TARGET "avx512f"
+#define MB_NAME sha256_x16_avx512
+#include "sha256_mb_kernel.h"
+#undef MB_LANES
+#undef MB_TARGET
+#undef MB_NAME
+
+#endif
+
+// Multi-buffer implementations, widest first
+static const t_mb_kernel _sha256_mb_kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx512-x16", CPU_AVX512F, 16, sha256_x16_avx512},
+    {"avx2-x8", CPU_AVX2, 8, sha256_x8_avx2},
+#endif
+    {NULL, 0, 0, NULL}
+};
+
+/**
+ * @brief Returns the widest multi-buffer SHA-256 implementation this CPU can run
+ *
+ * @note Returns NULL if the single-buffer kernel is as fast
+ *
+ * @return const t_mb_kernel* The kernel, NULL if there is none
+ */
+const t_mb_kernel *sha256_mb_kernel(void) {
+    const t_mb_kernel *kernel = mb_kernel_select(_sha256_mb_kernels);
+    // 8 lanes of AVX2 are about as fast as the SHA extensions alone, not worth the scheduling
+    if (kernel != NULL && kernel->lanes < 16 && IS_SET(cpu_features(), CPU_SHA)) {
+        return (NULL);
+    }
+    return (kernel);
+}
+
+/**
+ * @brief Returns every multi-buffer SHA-256 implementation, widest first
+ *
+ * @return const t_mb_kernel* NULL-terminated kernel table
+ */
+const t_mb_kernel *sha256_mb_kernels(void) {
+    return (_sha256_mb_kernels);
+}
@@ -0,0 +1,118 @@
+/**
+ * Multi-buffer SHA-256 compression function, "instantiated" once per vector width by sha256_mb.c:
+ * - MB_LANES: number of 32-bit lanes (independent messages)
+ * - MB_TARGET: instruction set the function is compiled for
+ * - MB_NAME: name of the generated function
+ *
+ * Every lane holds one message, lane `l` of each vector is word `i` of message `l`, so the 64 rounds run
+ * for all the messages at once, using GCC's vector extensions (lowered to AVX2 / AVX-512 by MB_TARGET).
+*/
+
+#define MB_VEC MB_CONCAT(MB_NAME, _vec)
+#define MB_CONCAT(a, b) MB_CONCAT_(a, b)
+#define MB_CONCAT_(a, b) a##b
+#define MB_ROR(x, c) (((x) >> (c)) | ((x) << (32 - (c))))
+
+typedef u32 MB_VEC __attribute__((vector_size(MB_LANES * 4)));
+
+/**
+ * @brief Runs nblocks compressions on up to MB_LANES messages at once
+ *
+ * @param digests Intermediate hash value of each lane (8 little endian 32-bit words), NULL for an unused lane
+ * @param data Message blocks of each lane, ignored for unused lanes
+ * @param nblocks Number of 64-byte blocks to process, the same for every lane
+ */
+__attribute__((target(MB_TARGET)))
+void MB_NAME(byte **digests, const byte **data, u64 nblocks) {
+    static const byte unused_block[SHA256_BLOCK_SIZE] = {0};
+    const byte *p[MB_LANES];
+    u64 stride[MB_LANES];
+    MB_VEC state[8], w[16], a, b, c, d, e, f, g, h, s0, s1, temp1, temp2;
+    u32 word, lane_words[MB_LANES];
+
+    // transpose the states, unused lanes hash a zero block that never moves
+    for (i32 l = 0; l < MB_LANES; l++) {
+        for (i32 i = 0; i < 8; i++) {
+            word = 0;
+            if (digests[l] != NULL) {
+                __builtin_memcpy(&word, digests[l] + i * 4, 4);
+            }
+            state[i][l] = word;
+        }
+        p[l] = digests[l] != NULL ? data[l] : unused_block;
+        stride[l] = digests[l] != NULL ? SHA256_BLOCK_SIZE : 0;
+    }
+
+    for (; nblocks > 0; nblocks--) {
+        // break into 16 32-bit big endian words, one message per lane
+#pragma GCC unroll 16
+        for (i32 i = 0; i < 16; i++) {
+#pragma GCC unroll 16
+            for (i32 l = 0; l < MB_LANES; l++) {
+                __builtin_memcpy(&word, p[l] + i * 4, 4);
+                lane_words[l] = __builtin_bswap32(word);
+            }
+            __builtin_memcpy(&w[i], lane_words, sizeof(lane_words));
+        }
+        for (i32 l = 0; l < MB_LANES; l++) {
+            p[l] += stride[l];
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        // main loop, the schedule is extended in place in a 16-word ring
+#pragma GCC unroll 64
+        for (i32 i = 0; i < 64; i++) {
+            if (i >= 16) {
+                s0 = MB_ROR(w[(i + 1) & 15], 7) ^ MB_ROR(w[(i + 1) & 15], 18) ^ (w[(i + 1) & 15] >> 3);
+                s1 = MB_ROR(w[(i + 14) & 15], 17) ^ MB_ROR(w[(i + 14) & 15], 19) ^ (w[(i + 14) & 15] >> 10);
+                w[i & 15] += s0 + w[(i + 9) & 15] + s1;
+            }
+            s1 = MB_ROR(e, 6) ^ MB_ROR(e, 11) ^ MB_ROR(e, 25);
+            temp1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i & 15];
+            s0 = MB_ROR(a, 2) ^ MB_ROR(a, 13) ^ MB_ROR(a, 22);
+            temp2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+    // transpose back
+    for (i32 l = 0; l < MB_LANES; l++) {
+        if (digests[l] == NULL) {
+            continue;
+        }
+        for (i32 i = 0; i < 8; i++) {
+            word = state[i][l];
+            __builtin_memcpy(digests[l] + i * 4, &word, 4);
+        }
+    }
+}
+
+#undef MB_VEC
+#undef MB_CONCAT
+#undef MB_CONCAT_
+#undef MB_ROR
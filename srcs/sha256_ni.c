@@ -0,0 +1,121 @@
+#include "ft_ssl.h"
+
+// https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sha-extensions.html
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/**
+ * Four rounds in the middle of the schedule, "cur" holds the message words of these rounds,
+ * "next" gets its words finished (msg2) and "prev" gets started (msg1) for later rounds.
+*/
+#define SHA256_NI_QROUND(cur, prev, next, i) \
+    msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *)(sha256_k + i))); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    tmp = _mm_alignr_epi8(cur, prev, 4); \
+    next = _mm_add_epi32(next, tmp); \
+    next = _mm_sha256msg2_epu32(next, cur); \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+    prev = _mm_sha256msg1_epu32(prev, cur);
+
+/**
+ * @brief SHA-256 compression function using the SHA extensions (sha256rnds2 / sha256msg1 / sha256msg2)
+ *
+ * @note Only selected by sha256_init when CPUID reports SHA + SSE4.1
+ *
+ * @param digest Intermediate hash value, 8 little endian 32-bit words
+ * @param data Message blocks
+ * @param nblocks Number of 64-byte blocks to process
+ */
+__attribute__((target("sha,sse4.1")))
+void sha256_ni_digest(byte *digest, const byte *data, u64 nblocks) {
+    // the instructions expect big endian words
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, msg0, msg1, msg2, msg3, abef, cdgh;
+
+    // h0..h7 -> ABEF / CDGH, the layout sha256rnds2 works with
+    tmp = _mm_loadu_si128((const __m128i *) digest);
+    state1 = _mm_loadu_si128((const __m128i *) (digest + 16));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abef = state0;
+        cdgh = state1;
+
+        // rounds 0-3
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), bswap);
+        msg = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i *) sha256_k));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+        // rounds 4-7
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), bswap);
+        msg = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *) (sha256_k + 4)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+        // rounds 8-11
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), bswap);
+        msg = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *) (sha256_k + 8)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+        // rounds 12-51, message schedule computed on the fly
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), bswap);
+        SHA256_NI_QROUND(msg3, msg2, msg0, 12);
+        SHA256_NI_QROUND(msg0, msg3, msg1, 16);
+        SHA256_NI_QROUND(msg1, msg0, msg2, 20);
+        SHA256_NI_QROUND(msg2, msg1, msg3, 24);
+        SHA256_NI_QROUND(msg3, msg2, msg0, 28);
+        SHA256_NI_QROUND(msg0, msg3, msg1, 32);
+        SHA256_NI_QROUND(msg1, msg0, msg2, 36);
+        SHA256_NI_QROUND(msg2, msg1, msg3, 40);
+        SHA256_NI_QROUND(msg3, msg2, msg0, 44);
+        SHA256_NI_QROUND(msg0, msg3, msg1, 48);
+
+        // rounds 52-59, last words of the schedule, nothing left to start
+        msg = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *) (sha256_k + 52)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        tmp = _mm_alignr_epi8(msg1, msg0, 4);
+        msg2 = _mm_add_epi32(msg2, tmp);
+        msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+        msg = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *) (sha256_k + 56)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        tmp = _mm_alignr_epi8(msg2, msg1, 4);
+        msg3 = _mm_add_epi32(msg3, tmp);
+        msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+        // rounds 60-63
+        msg = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i *) (sha256_k + 60)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+        // add this chunk's hash to result so far
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    // ABEF / CDGH -> h0..h7
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *) digest, state0);
+    _mm_storeu_si128((__m128i *) (digest + 16), state1);
+}
+#endif
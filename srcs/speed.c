@@ -0,0 +1,337 @@
+#include "ft_ssl.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The speed command, like `openssl speed`: every kernel this CPU can run hashes messages of
+ * SPEED_MIN_SIZE to SPEED_MAX_SIZE bytes from memory for a fixed time, each message being a whole
+ * hash (reset, chomp, final). Multi-buffer kernels hash one message per lane. A last table runs the
+ * kernel ft_ssl would pick on more and more threads, to see how far it scales.
+*/
+
+#define SPEED_MIN_SIZE 16
+#define SPEED_MAX_SIZE (16 * 1024 * 1024)
+#define SPEED_SWEEP_SIZE 65536 // message size of the thread sweep
+#define SPEED_BATCH 65536 // bytes hashed between two looks at the clock
+#define SPEED_DURATION_MS 100 // per measurement, FT_SSL_SPEED_MS overrides it
+
+/**
+ * Algorithms the speed command knows, with all of their implementations
+*/
+typedef struct s_speed_alg {
+    char *name;
+    init_func init;
+    const t_kernel *(*kernels)(void);
+    const t_mb_kernel *(*mb_kernels)(void);
+} t_speed_alg;
+
+static const t_speed_alg _speed_algs[] = {
+    {"md5", md5_init, md5_kernels, md5_mb_kernels},
+    {"sha256", sha256_init, sha256_kernels, sha256_mb_kernels},
+    {NULL, NULL, NULL, NULL}
+};
+
+/**
+ * One measurement, run by one thread
+*/
+typedef struct s_speed_run {
+    t_context ctx;                      // Context of the algorithm, with the kernel to measure
+    const t_mb_kernel *mb_kernel;       // Multi-buffer kernel to measure instead, NULL if none
+    const byte *data;                   // Message, padded past size for multi-buffer kernels
+    u64 size;                           // Size of a message
+    f64 duration;                       // Seconds to run for
+    u64 hashes;                         // Number of messages hashed
+    u64 cycles;                         // TSC cycles spent
+    f64 elapsed;                        // Seconds spent
+} t_speed_run;
+
+static f64 _now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/**
+ * @brief Hashes the same message over and over with a single-buffer kernel
+ */
+static void _speed_single(t_speed_run *run) {
+    u64 batch = run->size < SPEED_BATCH ? SPEED_BATCH / run->size : 1;
+    u64 start_cycles = cpu_cycles();
+    f64 start = _now();
+
+    do {
+        for (u64 i = 0; i < batch; i++) {
+            run->ctx.reset_fn(&run->ctx);
+            ctx_chomp(&run->ctx, run->data, run->size);
+            run->ctx.final_fn(&run->ctx);
+        }
+        run->hashes += batch;
+        run->elapsed = _now() - start;
+    } while (run->elapsed < run->duration);
+    run->cycles = cpu_cycles() - start_cycles;
+}
+
+/**
+ * @brief Hashes the same message in every lane of a multi-buffer kernel, over and over
+ *
+ * @note The message must already be padded, the lanes compress it straight from memory
+ */
+static void _speed_multi(t_speed_run *run) {
+    const t_mb_kernel *kernel = run->mb_kernel;
+    byte states[MB_MAX_LANES][MAX_DIGEST_SIZE];
+    byte *digests[MB_MAX_LANES];
+    const byte *data[MB_MAX_LANES];
+    u64 nblocks = (run->size + 9 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    u64 batch = run->size * kernel->lanes < SPEED_BATCH ? SPEED_BATCH / (run->size * kernel->lanes) : 1;
+    u64 start_cycles = cpu_cycles();
+    f64 start = _now();
+
+    run->ctx.reset_fn(&run->ctx);
+    for (u8 l = 0; l < kernel->lanes; l++) {
+        digests[l] = states[l];
+        data[l] = run->data;
+    }
+    do {
+        for (u64 i = 0; i < batch; i++) {
+            for (u8 l = 0; l < kernel->lanes; l++) {
+                ft_memcpy(states[l], run->ctx.digest, run->ctx.digest_size);
+            }
+            kernel->digest_fn(digests, data, nblocks);
+        }
+        run->hashes += batch * kernel->lanes;
+        run->elapsed = _now() - start;
+    } while (run->elapsed < run->duration);
+    run->cycles = cpu_cycles() - start_cycles;
+}
+
+static void *_speed_thread(void *arg) {
+    _speed_single(arg);
+    return (NULL);
+}
+
+/**
+ * @brief Pads a message in place, like the context would, for the multi-buffer kernels
+ *
+ * @param ctx Context of the algorithm
+ * @param data Message, with room for two more blocks
+ * @param size Size of the message
+ */
+static void _speed_pad(t_context *ctx, byte *data, u64 size) {
+    u64 tail = size % BLOCK_SIZE;
+
+    ctx->reset_fn(ctx);
+    ft_memcpy(ctx->buffer, data + size - tail, tail);
+    ctx->buffer_size = tail;
+    ctx->chomped_bytes = size;
+    ctx->pad_fn(ctx);
+    ft_memcpy(data + size - tail, ctx->buffer, ctx->buffer_size);
+}
+
+/**
+ * @brief Prints a string left-aligned in a column
+ */
+static void _speed_column(const char *s, i32 width) {
+    i32 length = ft_strlen(s);
+
+    ft_putstr_fd(1, s, length);
+    for (i32 i = length; i < width; i++) {
+        ft_putstr_fd(1, " ", 1);
+    }
+}
+
+/**
+ * @brief Prints a size with the largest unit that divides it, e.g. 16, 1K, 16M
+ */
+static void _speed_size(u64 size, i32 width) {
+    char out[24];
+    i32 length = 0;
+    char unit = '\0';
+
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+        size /= 1024 * 1024;
+        unit = 'M';
+    } else if (size >= 1024 && size % 1024 == 0) {
+        size /= 1024;
+        unit = 'K';
+    }
+    for (u64 n = size; n > 0 || length == 0; n /= 10) {
+        length++;
+    }
+    for (i32 i = length - 1; i >= 0; i--, size /= 10) {
+        out[i] = '0' + size % 10;
+    }
+    if (unit != '\0') {
+        out[length++] = unit;
+    }
+    for (i32 i = length; i < width; i++) {
+        ft_putstr_fd(1, " ", 1);
+    }
+    ft_putstr_fd(1, out, length);
+}
+
+/**
+ * @brief Prints a row of results: MB/s, cycles per byte and hashes per second
+ *
+ * @param rate Messages hashed per second
+ * @param size Size of a message
+ * @param cycles TSC cycles per byte, for one core
+ */
+static void _speed_row(f64 rate, u64 size, f64 cycles) {
+    ft_putfloat_fd(1, rate * size / 1e6, 1, 12);
+    ft_putfloat_fd(1, cycles, 2, 10);
+    ft_putfloat_fd(1, rate, 0, 12);
+    ft_putstr_fd(1, "\n", 1);
+}
+
+/**
+ * @brief Measures every kernel of an algorithm this CPU can run, on every message size
+ *
+ * @param alg Algorithm
+ * @param data Message buffer, SPEED_MAX_SIZE bytes and two blocks
+ * @param duration Seconds per measurement
+ */
+static void _speed_kernels(const t_speed_alg *alg, byte *data, f64 duration) {
+    const t_kernel *kernels = alg->kernels();
+    const t_mb_kernel *mb_kernels = alg->mb_kernels();
+    u32 features = cpu_features();
+    t_context ctx = alg->init(0);
+
+    ft_putstr_fd(1, ctx.alg_name, ft_strlen(ctx.alg_name));
+    ft_putstr_fd(1, "\nkernel           size        MB/s  cycles/B    hashes/s\n", 57);
+    for (i32 i = 0; kernels[i].name != NULL; i++) {
+        if (!IS_SET(features, kernels[i].cpu_flags)) {
+            continue;
+        }
+        for (u64 size = SPEED_MIN_SIZE; size <= SPEED_MAX_SIZE; size *= 4) {
+            t_speed_run run = {.ctx = ctx, .data = data, .size = size, .duration = duration};
+            run.ctx.digest_fn = kernels[i].digest_fn;
+            _speed_single(&run);
+            _speed_column(kernels[i].name, 12);
+            _speed_size(size, 5);
+            _speed_row(run.hashes / run.elapsed, size, (f64) run.cycles / (run.hashes * size));
+        }
+    }
+    for (i32 i = 0; mb_kernels[i].name != NULL; i++) {
+        if (!IS_SET(features, mb_kernels[i].cpu_flags)) {
+            continue;
+        }
+        for (u64 size = SPEED_MIN_SIZE; size <= SPEED_MAX_SIZE; size *= 4) {
+            t_speed_run run = {.ctx = ctx, .mb_kernel = &mb_kernels[i], .data = data, .size = size, .duration = duration};
+            _speed_pad(&run.ctx, data, size);
+            _speed_multi(&run);
+            _speed_column(mb_kernels[i].name, 12);
+            _speed_size(size, 5);
+            _speed_row(run.hashes / run.elapsed, size, (f64) run.cycles / (run.hashes * size));
+        }
+    }
+    ft_putstr_fd(1, "\n", 1);
+}
+
+/**
+ * @brief Runs the kernel ft_ssl picks on 1, 2, 4... threads up to jobs, all at once
+ *
+ * @param alg Algorithm
+ * @param data Message buffer, read by every thread
+ * @param duration Seconds per measurement
+ * @param jobs Max number of threads
+ */
+static void _speed_threads(const t_speed_alg *alg, const byte *data, f64 duration, i32 jobs) {
+    t_speed_run *runs = malloc(jobs * sizeof(t_speed_run));
+    pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+    t_context ctx = alg->init(0);
+
+    if (runs == NULL || threads == NULL) {
+        print_error(ERR_MEM_ALLOC_FAILED, "speed");
+        free(runs);
+        free(threads);
+        return ;
+    }
+    ft_putstr_fd(1, ctx.alg_name, ft_strlen(ctx.alg_name));
+    ft_putstr_fd(1, "\nthreads          size        MB/s  cycles/B    hashes/s\n", 57);
+    for (i32 count = 1; count <= jobs; count = count * 2 > jobs && count < jobs ? jobs : count * 2) {
+        i32 started = 0;
+        u64 hashes = 0, cycles = 0;
+        f64 rate = 0;
+        for (; started < count; started++) {
+            runs[started] = (t_speed_run) {.ctx = ctx, .data = data, .size = SPEED_SWEEP_SIZE, .duration = duration};
+            if (pthread_create(&threads[started], NULL, _speed_thread, &runs[started]) != 0) {
+                break;
+            }
+        }
+        for (i32 i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+            hashes += runs[i].hashes;
+            cycles += runs[i].cycles;
+            rate += runs[i].hashes / runs[i].elapsed;
+        }
+        if (started == 0) {
+            break;
+        }
+        // every thread ran for its own duration, their rates add up
+        ft_putfloat_fd(1, started, 0, 7);
+        _speed_column("", 5);
+        _speed_size(SPEED_SWEEP_SIZE, 5);
+        _speed_row(rate, SPEED_SWEEP_SIZE, (f64) cycles / (hashes * SPEED_SWEEP_SIZE));
+    }
+    ft_putstr_fd(1, "\n", 1);
+    free(runs);
+    free(threads);
+}
+
+/**
+ * @brief The speed command: ft_ssl speed [md5|sha256] [-j N]
+ *
+ * @param argc Number of arguments
+ * @param argv All passed arguments, the algorithm and -j come after argv[1]
+ * @return int Exit code
+ */
+int speed_command(int argc, char **argv) {
+    const t_speed_alg *selected = NULL;
+    t_options options = {0};
+    char *ms = getenv("FT_SSL_SPEED_MS");
+    f64 duration = (ms != NULL && *ms != '\0' ? strtoul(ms, NULL, 10) : SPEED_DURATION_MS) / 1000.0;
+    i32 selected_at = 0;
+    byte *data;
+
+    for (i32 i = 2; i < argc; i++) {
+        if (ft_strcmp(argv[i], "-j") == 0) {
+            if (!parse_jobs(i + 1 < argc ? argv[++i] : NULL, &options)) {
+                return (1);
+            }
+            continue;
+        }
+        for (i32 j = 0; selected == NULL && _speed_algs[j].name != NULL; j++) {
+            if (ft_strcmp(argv[i], _speed_algs[j].name) == 0) {
+                selected = &_speed_algs[j];
+                break;
+            }
+        }
+        // a single algorithm, once
+        if (selected == NULL || ft_strcmp(argv[i], selected->name) != 0 || selected_at != 0) {
+            print_error(ERR_INVALID_ALGORITHM, argv[i]);
+            return (1);
+        }
+        selected_at = i;
+    }
+    if (options.jobs == 0) {
+        options.jobs = default_jobs();
+    }
+    // the multi-buffer kernels read the padding right after the message
+    data = malloc(SPEED_MAX_SIZE + BLOCK_SIZE * 2);
+    if (data == NULL) {
+        print_error(ERR_MEM_ALLOC_FAILED, "speed");
+        return (1);
+    }
+    for (u64 i = 0; i < SPEED_MAX_SIZE + BLOCK_SIZE * 2; i++) {
+        data[i] = i * 31;
+    }
+    for (i32 i = 0; _speed_algs[i].name != NULL; i++) {
+        if (selected == NULL || selected == &_speed_algs[i]) {
+            _speed_kernels(&_speed_algs[i], data, duration);
+            _speed_threads(&_speed_algs[i], data, duration, options.jobs);
+        }
+    }
+    free(data);
+    return (0);
+}
@@ -0,0 +1,105 @@
+#include "ft_ssl.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Saved hash states (--save-state / --resume), so appending to a file only needs the new bytes
+ * to be hashed. A state is everything t_context needs to go on, not the whole buffer:
+ *
+ * | Field      | Size             | Content                                          |
+ * |------------|------------------|--------------------------------------------------|
+ * | magic      | 4                | "FTST"                                           |
+ * | version    | 1                | STATE_VERSION                                    |
+ * | name       | 1 + n            | Length and name of the algorithm, e.g. "SHA256"  |
+ * | state      | 1 + digest_size  | Size and words of the state, little-endian u32   |
+ * | total      | 8                | Bytes hashed so far, little-endian               |
+ * | tail       | 1 + tail         | Size and bytes of the incomplete block (< 64)    |
+*/
+
+#define STATE_MAGIC "FTST"
+#define STATE_VERSION 1
+#define STATE_MAX_SIZE (4 + 1 + 1 + 255 + 1 + MAX_DIGEST_SIZE + 8 + 1 + BLOCK_SIZE)
+
+/**
+ * @brief Writes the state of a context that hasn't been finalized yet
+ *
+ * @param ctx Hash context
+ * @param path Path of the state file, overwritten
+ * @return true Success, false if the file couldn't be written
+ */
+bool state_save(const t_context *ctx, const char *path) {
+    byte state[STATE_MAX_SIZE];
+    i32 size = 0, name = ft_strlen(ctx->alg_name);
+
+    ft_memcpy(state, STATE_MAGIC, 4);
+    size += 4;
+    state[size++] = STATE_VERSION;
+    state[size++] = name;
+    ft_memcpy(state + size, ctx->alg_name, name);
+    size += name;
+    state[size++] = ctx->digest_size;
+    for (u8 i = 0; i < ctx->digest_size; i += 4) {
+        u32 word;
+        ft_memcpy(&word, ctx->digest + i, 4);
+        for (i32 b = 0; b < 4; b++) {
+            state[size++] = word >> (b * 8);
+        }
+    }
+    for (i32 b = 0; b < 8; b++) {
+        state[size++] = ctx->chomped_bytes >> (b * 8);
+    }
+    state[size++] = ctx->buffer_size;
+    ft_memcpy(state + size, ctx->buffer, ctx->buffer_size);
+    size += ctx->buffer_size;
+
+    i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return (false);
+    }
+    bool ok = write(fd, state, size) == size;
+    return (close(fd) == 0 && ok);
+}
+
+/**
+ * @brief Restores a saved state into a context of the same algorithm
+ *
+ * @param ctx Hash context, chomped_bytes is the offset to resume from
+ * @param path Path of the state file
+ * @return true Success, false if the file can't be read or isn't a state of this algorithm
+ */
+bool state_load(t_context *ctx, const char *path) {
+    byte state[STATE_MAX_SIZE + 1];
+    i32 size = 0, name = ft_strlen(ctx->alg_name);
+    i64 length;
+    u64 total = 0;
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return (false);
+    }
+    length = read(fd, state, sizeof(state));
+    close(fd);
+    // everything up to the tail has a known size
+    if (length < 4 + 1 + 1 + name + 1 + ctx->digest_size + 8 + 1 || ft_memcmp(state, STATE_MAGIC, 4) != 0
+        || state[4] != STATE_VERSION || state[5] != name || ft_memcmp(state + 6, ctx->alg_name, name) != 0
+        || state[6 + name] != ctx->digest_size) {
+        return (false);
+    }
+    size = 6 + name + 1;
+    for (u8 i = 0; i < ctx->digest_size; i += 4) {
+        u32 word = LOAD_LE32(state + size);
+        ft_memcpy(ctx->digest + i, &word, 4);
+        size += 4;
+    }
+    for (i32 b = 0; b < 8; b++) {
+        total |= (u64) state[size++] << (b * 8);
+    }
+    // the tail is what's left of a block, it's consistent with the total
+    if (state[size] >= BLOCK_SIZE || state[size] != total % BLOCK_SIZE || length != size + 1 + state[size]) {
+        return (false);
+    }
+    ctx->buffer_size = state[size++];
+    ft_memcpy(ctx->buffer, state + size, ctx->buffer_size);
+    ctx->chomped_bytes = total;
+    return (true);
+}
@@ -0,0 +1,164 @@
+#include "ft_ssl.h"
+#include <limits.h>
+#include <time.h>
+
+/**
+ * Instrumentation (--stats): time spent in each phase of hashing, syscall and byte counters,
+ * printed to stderr at exit. Phases are timed with the TSC where there is one (a few cycles per
+ * reading), and converted to time with the wall clock measured over the whole run.
+ *
+ * When --stats isn't set, every STATS_* macro is a branch on a flag that never changes, the timers
+ * are not even read. Workers add to the same counters, phase times are CPU time summed over threads.
+*/
+
+#define STATS_LINE_SIZE (PATH_MAX + 256) // a line of stats_file, written at once
+
+bool stats_enabled = false;
+
+typedef struct s_stats {
+    u64 phases[STATS_PHASES];           // Ticks spent in each phase
+    u64 counters[STATS_COUNTERS];       // Syscalls, bytes and files
+    u64 start_ticks;                    // Ticks when --stats was enabled
+    struct timespec start;              // Time when --stats was enabled
+} t_stats;
+
+static t_stats _stats;
+
+static const char *_phase_names[STATS_PHASES] = {"read", "copy", "digest", "final", "output"};
+
+/**
+ * @brief Current value of the phase timer: TSC cycles on x86, nanoseconds otherwise
+ */
+u64 stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (cpu_cycles());
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+/**
+ * @brief Adds the ticks elapsed since start to a phase
+ *
+ * @param phase STATS_* phase
+ * @param start Value of stats_ticks when the phase started
+ */
+void stats_phase(u8 phase, u64 start) {
+    __atomic_fetch_add(&_stats.phases[phase], stats_ticks() - start, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Adds to a counter
+ *
+ * @param counter STATS_* counter
+ * @param n Amount
+ */
+void stats_count(u8 counter, u64 n) {
+    __atomic_fetch_add(&_stats.counters[counter], n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Nanoseconds per tick, measured over the whole run
+ */
+static f64 _stats_tick_ns(f64 elapsed_ns) {
+#if defined(__x86_64__) || defined(__i386__)
+    u64 ticks = stats_ticks() - _stats.start_ticks;
+    return (ticks > 0 ? elapsed_ns / ticks : 0);
+#else
+    (void) elapsed_ns;
+    return (1);
+#endif
+}
+
+/**
+ * @brief Reports a file that has just been hashed, as soon as it's done
+ *
+ * @note Workers report their files at the same time: the line is built first and written at once, so
+ * lines of different threads don't interleave. Longer paths are cut.
+ *
+ * @param path Path of the file
+ * @param bytes Size of the file
+ * @param start Value of stats_ticks before it was opened
+ */
+void stats_file(const char *path, u64 bytes, u64 start) {
+    char line[STATS_LINE_SIZE];
+    i32 path_size = ft_strlen(path);
+    i32 size = 15;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    f64 elapsed_ns = (now.tv_sec - _stats.start.tv_sec) * 1e9 + (now.tv_nsec - _stats.start.tv_nsec);
+    f64 ms = (stats_ticks() - start) * _stats_tick_ns(elapsed_ns) / 1e6;
+
+    stats_count(STATS_FILES, 1);
+    if (path_size > STATS_LINE_SIZE - 256) {
+        path_size = STATS_LINE_SIZE - 256;
+    }
+    ft_memcpy(line, "ft_ssl: stats: ", 15);
+    ft_memcpy(line + size, path, path_size);
+    size += path_size;
+    ft_memcpy(line + size, ": ", 2);
+    size += 2;
+    size += ft_nbrtostr(line + size, bytes);
+    ft_memcpy(line + size, " bytes in ", 10);
+    size += 10;
+    size += ft_floattostr(line + size, ms, 3, 0);
+    ft_memcpy(line + size, " ms, ", 5);
+    size += 5;
+    size += ft_floattostr(line + size, ms > 0 ? bytes / ms / 1e3 : 0, 1, 0);
+    ft_memcpy(line + size, " MB/s\n", 6);
+    size += 6;
+    ft_putstr_fd(2, line, size);
+}
+
+/**
+ * @brief Prints the totals, registered with atexit by stats_init
+ */
+static void _stats_print(void) {
+    struct timespec now;
+    // so the totals come after the results, and count the last write
+    output_flush();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    f64 elapsed_ns = (now.tv_sec - _stats.start.tv_sec) * 1e9 + (now.tv_nsec - _stats.start.tv_nsec);
+    f64 tick_ns = _stats_tick_ns(elapsed_ns);
+    u64 bytes = _stats.counters[STATS_BYTES];
+
+    ft_putstr_fd(2, "ft_ssl: stats: ", 15);
+    ft_putnbr_fd(2, _stats.counters[STATS_FILES]);
+    ft_putstr_fd(2, " files, ", 8);
+    ft_putnbr_fd(2, bytes);
+    ft_putstr_fd(2, " bytes in ", 10);
+    ft_putfloat_fd(2, elapsed_ns / 1e6, 3, 0);
+    ft_putstr_fd(2, " ms, ", 5);
+    ft_putfloat_fd(2, elapsed_ns > 0 ? bytes / elapsed_ns * 1e3 : 0, 1, 0);
+    ft_putstr_fd(2, " MB/s\nft_ssl: stats: syscalls: ", 31);
+    ft_putnbr_fd(2, _stats.counters[STATS_OPENS]);
+    ft_putstr_fd(2, " open, ", 7);
+    ft_putnbr_fd(2, _stats.counters[STATS_READS]);
+    ft_putstr_fd(2, " read, ", 7);
+    ft_putnbr_fd(2, _stats.counters[STATS_MAPS]);
+    ft_putstr_fd(2, " mmap, ", 7);
+    ft_putnbr_fd(2, _stats.counters[STATS_WRITES]);
+    ft_putstr_fd(2, " write\nft_ssl: stats: time:", 27);
+    for (u8 i = 0; i < STATS_PHASES; i++) {
+        ft_putstr_fd(2, i > 0 ? ", " : " ", i > 0 ? 2 : 1);
+        ft_putstr_fd(2, _phase_names[i], ft_strlen(_phase_names[i]));
+        ft_putstr_fd(2, " ", 1);
+        ft_putfloat_fd(2, _stats.phases[i] * tick_ns / 1e6, 3, 0);
+        ft_putstr_fd(2, " ms", 3);
+    }
+    ft_putstr_fd(2, "\n", 1);
+}
+
+/**
+ * @brief Turns the instrumentation on, the totals are printed at exit
+ *
+ * @note Must be called before any thread is started
+ */
+void stats_init(void) {
+    stats_enabled = true;
+    _stats.start_ticks = stats_ticks();
+    clock_gettime(CLOCK_MONOTONIC, &_stats.start);
+    atexit(_stats_print);
+}
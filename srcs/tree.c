@@ -0,0 +1,279 @@
+#include "ft_ssl.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Tree hashing (-t): the input is split into chunks of a fixed size, every chunk is hashed on its own
+ * (in parallel), and the chunk digests are combined into a Merkle root, the same way as RFC 6962:
+ * - leaf = H(0x00 || chunk), the last chunk may be shorter
+ * - node = H(0x01 || left || right), a node without sibling moves up a level as is
+ * - an empty input has no leaf, its root is H("")
+ *
+ * The root depends on the chunk size, it's part of the algorithm name printed (e.g. SHA256-TREE-1M).
+ * Leaves are hashed under map_guard, a mapped file that shrinks is a read error.
+*/
+
+#define TREE_LEAF 0x00
+#define TREE_NODE 0x01
+#define TREE_MAX_HEIGHT 64
+
+typedef struct s_tree_stack {
+    byte digests[TREE_MAX_HEIGHT][MAX_DIGEST_SIZE];
+    u8 heights[TREE_MAX_HEIGHT];
+    i32 size;
+} t_tree_stack;
+
+typedef struct s_tree {
+    t_context ctx;                      // Template context of the algorithm
+    const byte *data;                   // The whole input
+    u64 size;                           // Size of the input
+    u64 chunk;                          // Chunk size
+    u64 nchunks;                        // Number of chunks (leaves)
+    byte *leaves;                       // Digest of every leaf, NULL if they are merged one by one
+    u64 next;                           // Next chunk to hash, shared by the workers
+    bool failed;                        // The input went away under a worker (SIGBUS)
+    t_tree_stack stack;                 // Right edge of the tree, when the leaves are merged one by one
+} t_tree;
+
+/**
+ * @brief Hashes a chunk into a leaf digest
+ */
+static void _tree_leaf(t_context *ctx, const byte *data, u64 size, byte *out) {
+    const byte prefix = TREE_LEAF;
+
+    ctx->reset_fn(ctx);
+    ctx_chomp(ctx, &prefix, 1);
+    ctx_chomp(ctx, data, size);
+    ctx->final_fn(ctx);
+    ft_memcpy(out, ctx->digest, ctx->digest_size);
+}
+
+/**
+ * @brief Pushes a digest on the stack, merging the nodes of the same height
+ *
+ * @note The stack is the right edge of the tree, its heights are strictly decreasing
+ */
+static void _tree_push(t_context *ctx, t_tree_stack *stack, const byte *digest) {
+    const byte prefix = TREE_NODE;
+    u8 height = 0;
+    byte node[MAX_DIGEST_SIZE];
+
+    ft_memcpy(node, digest, ctx->digest_size);
+    while (stack->size > 0 && stack->heights[stack->size - 1] == height) {
+        stack->size--;
+        ctx->reset_fn(ctx);
+        ctx_chomp(ctx, &prefix, 1);
+        ctx_chomp(ctx, stack->digests[stack->size], ctx->digest_size);
+        ctx_chomp(ctx, node, ctx->digest_size);
+        ctx->final_fn(ctx);
+        ft_memcpy(node, ctx->digest, ctx->digest_size);
+        height++;
+    }
+    ft_memcpy(stack->digests[stack->size], node, ctx->digest_size);
+    stack->heights[stack->size++] = height;
+}
+
+/**
+ * @brief Merges what's left on the stack from right to left, the root ends up in ctx->digest
+ */
+static void _tree_root(t_context *ctx, t_tree_stack *stack) {
+    const byte prefix = TREE_NODE;
+    byte right[MAX_DIGEST_SIZE];
+
+    if (stack->size == 0) {
+        ctx->reset_fn(ctx);
+        ctx->final_fn(ctx);
+        return ;
+    }
+    ft_memcpy(right, stack->digests[--stack->size], ctx->digest_size);
+    while (stack->size > 0) {
+        ctx->reset_fn(ctx);
+        ctx_chomp(ctx, &prefix, 1);
+        ctx_chomp(ctx, stack->digests[--stack->size], ctx->digest_size);
+        ctx_chomp(ctx, right, ctx->digest_size);
+        ctx->final_fn(ctx);
+        ft_memcpy(right, ctx->digest, ctx->digest_size);
+    }
+    ft_memcpy(ctx->digest, right, ctx->digest_size);
+}
+
+static void _tree_leaves(void *arg) {
+    t_tree *tree = arg;
+    t_context ctx = tree->ctx;
+    u64 i, size;
+
+    while (!__atomic_load_n(&tree->failed, __ATOMIC_RELAXED)
+        && (i = __atomic_fetch_add(&tree->next, 1, __ATOMIC_RELAXED)) < tree->nchunks) {
+        size = tree->size - i * tree->chunk < tree->chunk ? tree->size - i * tree->chunk : tree->chunk;
+        _tree_leaf(&ctx, tree->data + i * tree->chunk, size, tree->leaves + i * ctx.digest_size);
+    }
+}
+
+static void *_tree_worker(void *arg) {
+    t_tree *tree = arg;
+
+    if (!map_guard(_tree_leaves, tree)) {
+        __atomic_store_n(&tree->failed, true, __ATOMIC_RELAXED);
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Out of memory for the leaves: hashes them one by one on the calling thread, merged right away
+ */
+static void _tree_serial(void *arg) {
+    t_tree *tree = arg;
+    byte leaf[MAX_DIGEST_SIZE];
+
+    for (u64 i = 0; i < tree->nchunks; i++) {
+        u64 size = tree->size - i * tree->chunk < tree->chunk ? tree->size - i * tree->chunk : tree->chunk;
+        _tree_leaf(&tree->ctx, tree->data + i * tree->chunk, size, leaf);
+        _tree_push(&tree->ctx, &tree->stack, leaf);
+    }
+}
+
+/**
+ * @brief Tree hashes an input that is entirely in memory, the leaves are hashed on several threads
+ *
+ * @param ctx Hash context, the root ends up in ctx->digest
+ * @param data Input
+ * @param size Size of the input
+ * @param chunk Chunk size
+ * @param jobs Number of threads (the calling one included)
+ * @return true Success, false if the input is a mapped file that shrank
+ */
+bool tree_hash_buffer(t_context *ctx, const byte *data, u64 size, u64 chunk, i32 jobs) {
+    t_tree tree = {.ctx = *ctx, .data = data, .size = size, .chunk = chunk, .nchunks = (size + chunk - 1) / chunk};
+    pthread_t threads[MAX_JOBS];
+    i32 started = 0;
+
+    tree.leaves = malloc(tree.nchunks * ctx->digest_size + 1);
+    if (tree.leaves == NULL) {
+        if (!map_guard(_tree_serial, &tree)) {
+            return (false);
+        }
+        _tree_root(ctx, &tree.stack);
+        return (true);
+    }
+    if ((u64) jobs > tree.nchunks) {
+        jobs = tree.nchunks;
+    }
+    for (; started + 1 < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, _tree_worker, &tree) != 0) {
+            break;
+        }
+    }
+    _tree_worker(&tree);
+    for (i32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (u64 i = 0; i < tree.nchunks && !tree.failed; i++) {
+        _tree_push(ctx, &tree.stack, tree.leaves + i * ctx->digest_size);
+    }
+    free(tree.leaves);
+    if (tree.failed) {
+        return (false);
+    }
+    _tree_root(ctx, &tree.stack);
+    return (true);
+}
+
+/**
+ * @brief Tree hashes a stream, chunk after chunk as they are read
+ *
+ * @return true Success, false if reading failed
+ */
+static bool _tree_hash_stream(t_context *ctx, i32 fd, u64 chunk) {
+    const byte prefix = TREE_LEAF;
+    t_tree_stack stack = {.size = 0};
+    byte buffer[BUFFER_SIZE];
+    u64 filled = 0;
+    i64 bytes_read;
+
+    while ((bytes_read = read(fd, buffer, BUFFER_SIZE)) > 0) {
+        for (u64 used = 0, n; used < (u64) bytes_read; used += n) {
+            if (filled == 0) {
+                ctx->reset_fn(ctx);
+                ctx_chomp(ctx, &prefix, 1);
+            }
+            n = (u64) bytes_read - used < chunk - filled ? (u64) bytes_read - used : chunk - filled;
+            ctx_chomp(ctx, buffer + used, n);
+            filled += n;
+            if (filled == chunk) {
+                ctx->final_fn(ctx);
+                _tree_push(ctx, &stack, ctx->digest);
+                filled = 0;
+            }
+        }
+    }
+    if (bytes_read == -1) {
+        return (false);
+    }
+    // last, shorter chunk
+    if (filled > 0) {
+        ctx->final_fn(ctx);
+        _tree_push(ctx, &stack, ctx->digest);
+    }
+    _tree_root(ctx, &stack);
+    return (true);
+}
+
+/**
+ * @brief Tree hashes a file, regular files are mapped and their chunks hashed in parallel
+ *
+ * @param ctx Hash context, the root ends up in ctx->digest
+ * @param fd File descriptor, read until the end
+ * @param chunk Chunk size
+ * @param jobs Number of threads
+ * @return true Success, false if reading failed
+ */
+bool tree_hash_fd(t_context *ctx, i32 fd, u64 chunk, i32 jobs) {
+    struct stat st;
+    byte *map;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && lseek(fd, 0, SEEK_CUR) == 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            bool ok = tree_hash_buffer(ctx, map, st.st_size, chunk, jobs);
+            munmap(map, st.st_size);
+            return (ok);
+        }
+    }
+    return (_tree_hash_stream(ctx, fd, chunk));
+}
+
+/**
+ * @brief Appends the chunk size to the algorithm name, e.g. SHA256-TREE-1M
+ *
+ * @param ctx Hash context
+ * @param chunk Chunk size, a power of two
+ */
+void tree_alg_name(t_context *ctx, u64 chunk) {
+    static char name[32];
+    const char *units = "KMG";
+    char digits[24];
+    i32 length = 0, unit = -1;
+
+    while (chunk >= 1024 && unit < 2) {
+        chunk /= 1024;
+        unit++;
+    }
+    do {
+        digits[length++] = '0' + chunk % 10;
+        chunk /= 10;
+    } while (chunk > 0);
+    i32 n = ft_strlen(ctx->alg_name);
+    ft_memcpy(name, ctx->alg_name, n);
+    ft_memcpy(name + n, "-TREE-", 6);
+    n += 6;
+    while (length > 0) {
+        name[n++] = digits[--length];
+    }
+    if (unit >= 0) {
+        name[n++] = units[unit];
+    }
+    name[n] = '\0';
+    ctx->alg_name = name;
+}
@@ -0,0 +1,198 @@
+#include "ft_ssl.h"
+
+/**
+ * Minimal io_uring wrapper (no liburing): one submission queue of reads, one completion queue.
+ * Everything goes through the raw syscalls, the rings are shared with the kernel through mmap().
+ *
+ * https://kernel.dk/io_uring.pdf
+*/
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <unistd.h>
+
+static i32 _uring_setup(u32 entries, struct io_uring_params *params) {
+    return ((i32) syscall(__NR_io_uring_setup, entries, params));
+}
+
+static i32 _uring_enter(i32 fd, u32 to_submit, u32 min_complete, u32 flags) {
+    return ((i32) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0));
+}
+
+static i32 _uring_register(i32 fd, u32 opcode, void *arg, u32 nr_args) {
+    return ((i32) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/**
+ * @brief Sets up a ring and registers the buffers reads will land in
+ *
+ * @note FT_SSL_URING=0 disables io_uring, like a kernel without it would.
+ * If the buffers can't be registered (RLIMIT_MEMLOCK), plain reads are used instead of fixed ones.
+ *
+ * @param ring Ring to set up
+ * @param entries Max number of reads in flight
+ * @param buffers Buffers, read n lands in buffers[n] when its buf_index is n
+ * @param count Number of buffers
+ * @param size Size of every buffer
+ * @return true The ring is ready, false if io_uring is not available (the ring is left unusable)
+ */
+bool uring_init(t_uring *ring, u32 entries, byte **buffers, u32 count, u32 size) {
+    struct io_uring_params params;
+    struct iovec iovecs[count];
+    char *env = getenv("FT_SSL_URING");
+
+    ring->fd = -1;
+    if (env != NULL && env[0] == '0') {
+        return (false);
+    }
+    ft_memset(&params, 0, sizeof(params));
+    ring->fd = _uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return (false);
+    }
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // recent kernels map both rings at once
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+    if (ring->sq_ring != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        uring_destroy(ring);
+        return (false);
+    }
+    ring->sq_tail = (u32 *) ((byte *) ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (u32 *) ((byte *) ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (u32 *) ((byte *) ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (u32 *) ((byte *) ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (u32 *) ((byte *) ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (u32 *) ((byte *) ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (byte *) ring->cq_ring + params.cq_off.cqes;
+    ring->to_submit = 0;
+
+    // fixed buffers save the kernel from mapping the pages of every read
+    for (u32 i = 0; i < count; i++) {
+        iovecs[i].iov_base = buffers[i];
+        iovecs[i].iov_len = size;
+    }
+    ring->fixed = _uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovecs, count) == 0;
+    return (true);
+}
+
+/**
+ * @brief Tears a ring down
+ *
+ * @note Reads still in flight are cancelled, their buffers must not be relied on
+ *
+ * @param ring Ring set up by uring_init
+ */
+void uring_destroy(t_uring *ring) {
+    if (ring->fd == -1) {
+        return ;
+    }
+    if (ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+/**
+ * @brief Queues a read, it is submitted by the next uring_wait
+ *
+ * @note The caller must never have more reads in flight than the ring has entries
+ *
+ * @param ring Ring
+ * @param fd File to read
+ * @param buf Where the bytes go, inside buffers[buf_index]
+ * @param len Number of bytes to read
+ * @param offset Offset in the file
+ * @param buf_index Index of the registered buffer buf is in
+ * @param user_data Handed back with the completion
+ */
+void uring_read(t_uring *ring, i32 fd, byte *buf, u32 len, u64 offset, u16 buf_index, u64 user_data) {
+    u32 tail = *ring->sq_tail;
+    u32 index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe *) ring->sqes)[index];
+
+    ft_memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ring->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (u64) buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->buf_index = buf_index;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    // the kernel must see the entry before the new tail
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+}
+
+/**
+ * @brief Submits the queued reads and waits for a completion
+ *
+ * @param ring Ring
+ * @param user_data user_data of the completed read
+ * @param res Result of the read, like read() would return but -errno on failure
+ * @return true A read completed, false if io_uring_enter failed
+ */
+bool uring_wait(t_uring *ring, u64 *user_data, i32 *res) {
+    u32 head = *ring->cq_head;
+    i32 ret;
+
+    while (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        ret = _uring_enter(ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            return (false);
+        } else if (ret > 0) {
+            ring->to_submit -= ret;
+        }
+    }
+    struct io_uring_cqe *cqe = &((struct io_uring_cqe *) ring->cqes)[head & *ring->cq_mask];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    // hand the entry back to the kernel once it's been read
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return (true);
+}
+#else
+bool uring_init(t_uring *ring, u32 entries, byte **buffers, u32 count, u32 size) {
+    (void) entries, (void) buffers, (void) count, (void) size;
+    ring->fd = -1;
+    return (false);
+}
+
+void uring_destroy(t_uring *ring) {
+    (void) ring;
+}
+
+void uring_read(t_uring *ring, i32 fd, byte *buf, u32 len, u64 offset, u16 buf_index, u64 user_data) {
+    (void) ring, (void) fd, (void) buf, (void) len, (void) offset, (void) buf_index, (void) user_data;
+}
+
+bool uring_wait(t_uring *ring, u64 *user_data, i32 *res) {
+    (void) ring, (void) user_data, (void) res;
+    return (false);
+}
+#endif
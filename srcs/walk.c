@@ -0,0 +1,374 @@
+#include "ft_ssl.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/**
+ * Recursive hashing (-R): the paths are the roots of a tree the workers build while they hash it.
+ * A task is a node, listing a directory (openat + getdents64, no stat unless the filesystem doesn't
+ * report types) adds its entries as new nodes, hashing a file fills its digest. Tasks are taken
+ * from a stack, the first entry of a directory on top, so the walk goes depth first, in the order
+ * the results are printed.
+ *
+ * The main thread prints the tree as nodes are done: the roots in the order they were given, the
+ * files under a directory in byte order of their paths, as `find dir -type f | LC_ALL=C sort` lists them. Only
+ * regular files are hashed, symbolic links and special files met on the way are skipped.
+*/
+
+#define WALK_UNKNOWN    0 // a root, a directory or anything else
+#define WALK_DIR        1
+#define WALK_FILE       2
+
+typedef struct s_walk_node {
+    char *path;                         // Path, allocated unless it's a root
+    struct s_walk_node *children;       // Entries of a directory, sorted
+    u32 nchildren;
+    struct s_walk_node *next;           // Next task of the stack
+    byte digest[MAX_DIGEST_SIZE];       // The final hash value, for a file
+    u8 type;                            // WALK_* type
+    u8 status;                          // FILE_* status
+} t_walk_node;
+
+// Entry of a directory being read, the name points into the getdents64 buffer
+typedef struct s_dirent64 {
+    u64 d_ino;
+    i64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} t_dirent64;
+
+typedef struct s_walk {
+    t_walk_node *tasks;                 // Stack of nodes to list or hash
+    u8 alg;                             // FLAG_ALG_* of the context, to look files up in the cache
+    bool finished;                      // Set by the main thread once everything is printed
+    t_walk_node *waiting;               // Node the main thread waits for, the only one worth a wake-up
+    pthread_mutex_t lock;               // Protects the stack and the status of the nodes
+    pthread_cond_t task_cond;           // Signaled when tasks are pushed
+    pthread_cond_t done_cond;           // Signaled when the node the main thread waits for is done
+} t_walk;
+
+static t_walk _walk = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .task_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static i32 _walk_getdents(i32 fd, byte *buffer, u64 size) {
+    return ((i32) syscall(SYS_getdents64, fd, buffer, size));
+}
+
+/**
+ * @brief Orders the entries of a directory, a directory sorts as if its path ended with a slash,
+ * like the paths of its own entries: "a.txt" < "a/" < "a0", the output is in byte order of the paths
+ */
+static i32 _walk_compare(const void *a, const void *b) {
+    const t_walk_node *x = a, *y = b;
+    const u8 *s1 = (const u8 *) x->path, *s2 = (const u8 *) y->path;
+
+    while (*s1 != '\0' && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return ((*s1 != '\0' ? *s1 : x->type == WALK_DIR ? '/' : 0) - (*s2 != '\0' ? *s2 : y->type == WALK_DIR ? '/' : 0));
+}
+
+/**
+ * @brief Marks a node as done, pushes its entries if it's a directory
+ *
+ * @param node Node
+ * @param status FILE_* status
+ */
+static void _walk_done(t_walk_node *node, u8 status) {
+    pthread_mutex_lock(&_walk.lock);
+    // the first entry ends up on top
+    for (u32 i = node->nchildren; i > 0; i--) {
+        node->children[i - 1].next = _walk.tasks;
+        _walk.tasks = &node->children[i - 1];
+    }
+    if (node->nchildren > 0) {
+        pthread_cond_broadcast(&_walk.task_cond);
+    }
+    node->status = status;
+    if (node == _walk.waiting) {
+        pthread_cond_signal(&_walk.done_cond);
+    }
+    pthread_mutex_unlock(&_walk.lock);
+}
+
+/**
+ * @brief Adds an entry to the children of a directory
+ *
+ * @param dir Directory node
+ * @param capacity Number of children allocated, grown when full
+ * @param name Name of the entry
+ * @param type WALK_DIR or WALK_FILE
+ * @return true Added, false if memory ran out
+ */
+static bool _walk_add(t_walk_node *dir, u32 *capacity, const char *name, u8 type) {
+    i32 dir_length = ft_strlen(dir->path), name_length = ft_strlen(name);
+    bool slash = dir_length > 0 && dir->path[dir_length - 1] != '/';
+    t_walk_node *node;
+
+    if (dir->nchildren == *capacity) {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        node = realloc(dir->children, *capacity * sizeof(t_walk_node));
+        if (node == NULL) {
+            return (false);
+        }
+        dir->children = node;
+    }
+    node = &dir->children[dir->nchildren];
+    node->path = malloc(dir_length + slash + name_length + 1);
+    if (node->path == NULL) {
+        return (false);
+    }
+    ft_memcpy(node->path, dir->path, dir_length);
+    node->path[dir_length] = '/';
+    ft_memcpy(node->path + dir_length + slash, name, name_length + 1);
+    node->children = NULL;
+    node->nchildren = 0;
+    node->type = type;
+    node->status = FILE_PENDING;
+    dir->nchildren++;
+    return (true);
+}
+
+/**
+ * @brief Reads the entries of a directory into its children, sorted by name
+ *
+ * @param node Directory node
+ * @param fd Directory, closed by the caller
+ * @return true Success, false if it couldn't be read (the entries read so far are kept)
+ */
+static bool _walk_list(t_walk_node *node, i32 fd) {
+    byte buffer[WALK_DENTS_SIZE];
+    u32 capacity = 0;
+    i32 length;
+    struct stat st;
+
+    while ((length = _walk_getdents(fd, buffer, sizeof(buffer))) > 0) {
+        STATS_COUNT(STATS_READS, 1);
+        for (i32 offset = 0; offset < length; offset += ((t_dirent64 *) (buffer + offset))->d_reclen) {
+            t_dirent64 *entry = (t_dirent64 *) (buffer + offset);
+            u8 type = entry->d_type;
+            if (ft_strcmp(entry->d_name, ".") == 0 || ft_strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            // some filesystems don't fill d_type
+            if (type == DT_UNKNOWN && fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if ((type == DT_DIR || type == DT_REG)
+                && !_walk_add(node, &capacity, entry->d_name, type == DT_DIR ? WALK_DIR : WALK_FILE)) {
+                length = -1;
+                break;
+            }
+        }
+        if (length == -1) {
+            break;
+        }
+    }
+    qsort(node->children, node->nchildren, sizeof(t_walk_node), _walk_compare);
+    return (length == 0);
+}
+
+/**
+ * @brief Hashes a regular file, or a root that isn't a directory
+ *
+ * @param ctx Context of the worker
+ * @param node Node of the file
+ * @return u8 FILE_* status
+ */
+static u8 _walk_hash(t_context *ctx, t_walk_node *node) {
+    u8 status = FILE_DONE;
+    t_cache_key key;
+    u64 start = STATS_START(), final;
+    i32 fd;
+
+    if (cache_lookup(node->path, _walk.alg, node->digest, ctx->digest_size, &key)) {
+        return (FILE_DONE);
+    } else if ((fd = open(node->path, O_RDONLY)) == -1) {
+        return (FILE_NOT_FOUND);
+    }
+    STATS_COUNT(STATS_OPENS, 1);
+    STATS_STOP(STATS_READ, start);
+    ctx->reset_fn(ctx);
+    if (ctx_chomp_fd(ctx, 1, fd)) {
+        final = STATS_START();
+        ctx->final_fn(ctx);
+        STATS_STOP(STATS_FINAL, final);
+        ft_memcpy(node->digest, ctx->digest, ctx->digest_size);
+        cache_store(&key, fd, node->digest, ctx->digest_size);
+    } else {
+        status = FILE_READ_FAILED;
+    }
+    close(fd);
+    if (stats_enabled && status == FILE_DONE) {
+        stats_file(node->path, ctx->chomped_bytes, start);
+    }
+    return (status);
+}
+
+/**
+ * @brief Lists or hashes a node
+ *
+ * @param ctx Context of the worker
+ * @param node Node taken from the stack
+ */
+static void _walk_task(t_context *ctx, t_walk_node *node) {
+    i32 fd;
+
+    if (node->type == WALK_FILE) {
+        _walk_done(node, _walk_hash(ctx, node));
+        return ;
+    }
+    fd = openat(AT_FDCWD, node->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 && errno == ENOTDIR && node->type == WALK_UNKNOWN) {
+        node->type = WALK_FILE;
+        _walk_done(node, _walk_hash(ctx, node));
+        return ;
+    } else if (fd == -1) {
+        _walk_done(node, errno == ENOENT ? FILE_NOT_FOUND : FILE_READ_FAILED);
+        return ;
+    }
+    STATS_COUNT(STATS_OPENS, 1);
+    node->type = WALK_DIR;
+    bool listed = _walk_list(node, fd);
+    close(fd);
+    _walk_done(node, listed ? FILE_DONE : FILE_READ_FAILED);
+}
+
+static void *_walk_worker(void *arg) {
+    t_context ctx = *(t_context *) arg;
+    t_walk_node *node;
+
+    while (true) {
+        pthread_mutex_lock(&_walk.lock);
+        while (_walk.tasks == NULL && !_walk.finished) {
+            pthread_cond_wait(&_walk.task_cond, &_walk.lock);
+        }
+        node = _walk.tasks;
+        if (node != NULL) {
+            _walk.tasks = node->next;
+        }
+        pthread_mutex_unlock(&_walk.lock);
+        if (node == NULL) {
+            return (NULL);
+        }
+        _walk_task(&ctx, node);
+    }
+}
+
+/**
+ * @brief Waits for a node to be done, the main thread takes tasks too rather than sleeping
+ *
+ * @note A wake-up per file would cost more than hashing a small file, the main thread only sleeps
+ * when the stack is empty and the node is being worked on by a worker
+ *
+ * @param work Context the main thread hashes with
+ * @param node Node to wait for
+ */
+static void _walk_wait(t_context *work, t_walk_node *node) {
+    t_walk_node *task;
+
+    pthread_mutex_lock(&_walk.lock);
+    _walk.waiting = node;
+    while (node->status == FILE_PENDING) {
+        if (_walk.tasks == NULL) {
+            pthread_cond_wait(&_walk.done_cond, &_walk.lock);
+            continue;
+        }
+        task = _walk.tasks;
+        _walk.tasks = task->next;
+        pthread_mutex_unlock(&_walk.lock);
+        _walk_task(work, task);
+        pthread_mutex_lock(&_walk.lock);
+    }
+    pthread_mutex_unlock(&_walk.lock);
+}
+
+/**
+ * @brief Prints a node once it's done, then the entries of a directory, frees them
+ *
+ * @param ctx Context to print with
+ * @param work Context the main thread hashes with while it waits
+ * @param node Node
+ * @param flags Output flags
+ */
+static void _walk_print(t_context *ctx, t_context *work, t_walk_node *node, u8 flags) {
+    _walk_wait(work, node);
+    if (node->status == FILE_NOT_FOUND) {
+        print_error(ERR_FILE_NOT_FOUND, node->path);
+    } else if (node->status == FILE_READ_FAILED) {
+        print_error(ERR_FILE_READ_FAILED, node->path);
+    } else if (node->type == WALK_FILE) {
+        ft_memcpy(ctx->digest, node->digest, ctx->digest_size);
+        ctx_print_digest(ctx, node->path, true, flags);
+    }
+    // a directory that couldn't be read to the end still has the entries read before the error
+    for (u32 i = 0; i < node->nchildren; i++) {
+        _walk_print(ctx, work, &node->children[i], flags);
+        free(node->children[i].path);
+    }
+    free(node->children);
+}
+
+/**
+ * @brief Hashes the regular files under a list of paths on several threads, prints digests in order
+ *
+ * @note The context is only used as a template and to print. The main thread is one of the jobs,
+ * it prints and works in between.
+ *
+ * @param ctx Hash context
+ * @param paths Directories or files, walked in this order
+ * @param count Number of paths
+ * @param flags Output flags
+ * @param jobs Number of threads, 0 for one per CPU
+ * @return true The paths have been hashed, false if memory ran out (nothing done)
+ */
+bool walk_hash_paths(t_context *ctx, char **paths, i32 count, u8 flags, i32 jobs) {
+    t_walk_node *roots = malloc(count * sizeof(t_walk_node));
+    pthread_t *threads = NULL;
+    t_context template = *ctx, work = *ctx;
+    i32 started = 0;
+
+    if (jobs == 0) {
+        jobs = default_jobs();
+    }
+    threads = malloc(jobs * sizeof(pthread_t));
+    if (roots == NULL || threads == NULL) {
+        free(roots);
+        free(threads);
+        return (false);
+    }
+    _walk.alg = flags & (FLAG_ALG_MD5 | FLAG_ALG_SHA256);
+    _walk.finished = false;
+    _walk.tasks = NULL;
+    for (i32 i = count - 1; i >= 0; i--) {
+        roots[i] = (t_walk_node) {.path = paths[i], .next = _walk.tasks, .type = WALK_UNKNOWN, .status = FILE_PENDING};
+        _walk.tasks = &roots[i];
+    }
+    for (i32 i = 1; i < jobs; i++) {
+        started += pthread_create(&threads[started], NULL, _walk_worker, &template) == 0;
+    }
+
+    for (i32 i = 0; i < count; i++) {
+        _walk_print(ctx, &work, &roots[i], flags);
+    }
+
+    pthread_mutex_lock(&_walk.lock);
+    _walk.finished = true;
+    pthread_cond_broadcast(&_walk.task_cond);
+    pthread_mutex_unlock(&_walk.lock);
+    for (i32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(roots);
+    free(threads);
+    return (true);
+}